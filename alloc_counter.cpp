@@ -0,0 +1,153 @@
+/*
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "alloc_counter.hpp"
+#include <cstdlib>
+#include <new>
+
+static thread_local AllocationCount totals;
+
+static void *counted_alloc(std::size_t _size,
+                           std::size_t _align) noexcept
+{
+    if (_size == 0)
+    {
+        _size = 1;
+    }
+
+    void *out;
+    if (_align <= alignof(std::max_align_t))
+    {
+        out = malloc(_size);
+    }
+    else
+    {
+        // aligned_alloc needs a multiple of the alignment
+        _size = (_size + _align - 1) / _align * _align;
+        out = aligned_alloc(_align, _size);
+    }
+
+    if (out != nullptr)
+    {
+        ++totals.allocations;
+        totals.bytes += _size;
+    }
+    return out;
+}
+
+static void counted_free(void *_ptr) noexcept
+{
+    if (_ptr != nullptr)
+    {
+        ++totals.deallocations;
+        free(_ptr);
+    }
+}
+
+AllocationCount allocation_count() noexcept
+{
+    return totals;
+}
+
+AllocationScope::AllocationScope() noexcept
+    : begin(allocation_count())
+{
+}
+
+AllocationCount AllocationScope::count() const noexcept
+{
+    AllocationCount now = allocation_count(), out;
+    out.allocations = now.allocations - begin.allocations;
+    out.deallocations = now.deallocations - begin.deallocations;
+    out.bytes = now.bytes - begin.bytes;
+    return out;
+}
+
+////////////////////////////////////////////////////////////////
+// Replacements for the global allocation functions
+
+void *operator new(std::size_t _size)
+{
+    void *out = counted_alloc(_size, 0);
+    if (out == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return out;
+}
+
+void *operator new[](std::size_t _size)
+{
+    return operator new(_size);
+}
+
+void *operator new(std::size_t _size, std::align_val_t _align)
+{
+    void *out = counted_alloc(_size, (std::size_t)_align);
+    if (out == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return out;
+}
+
+void *operator new[](std::size_t _size, std::align_val_t _align)
+{
+    return operator new(_size, _align);
+}
+
+void *operator new(std::size_t _size,
+                   const std::nothrow_t &) noexcept
+{
+    return counted_alloc(_size, 0);
+}
+
+void *operator new[](std::size_t _size,
+                     const std::nothrow_t &) noexcept
+{
+    return counted_alloc(_size, 0);
+}
+
+void operator delete(void *_ptr) noexcept
+{
+    counted_free(_ptr);
+}
+
+void operator delete[](void *_ptr) noexcept
+{
+    counted_free(_ptr);
+}
+
+void operator delete(void *_ptr, std::size_t) noexcept
+{
+    counted_free(_ptr);
+}
+
+void operator delete[](void *_ptr, std::size_t) noexcept
+{
+    counted_free(_ptr);
+}
+
+void operator delete(void *_ptr, std::align_val_t) noexcept
+{
+    counted_free(_ptr);
+}
+
+void operator delete[](void *_ptr, std::align_val_t) noexcept
+{
+    counted_free(_ptr);
+}
+
+void operator delete(void *_ptr, std::size_t,
+                     std::align_val_t) noexcept
+{
+    counted_free(_ptr);
+}
+
+void operator delete[](void *_ptr, std::size_t,
+                       std::align_val_t) noexcept
+{
+    counted_free(_ptr);
+}
@@ -0,0 +1,51 @@
+/*
+Allocation accounting for instrumentation builds. Linking
+`alloc_counter.o` into a program replaces the global `operator
+new` and `operator delete` with versions which count, per
+thread, every heap allocation made through them. Programs which
+do not link it are unaffected.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+Heap activity on a single thread.
+*/
+struct AllocationCount
+{
+    uint64_t allocations = 0, deallocations = 0, bytes = 0;
+
+    inline AllocationCount &operator+=(
+        const AllocationCount &_other) noexcept
+    {
+        allocations += _other.allocations;
+        deallocations += _other.deallocations;
+        bytes += _other.bytes;
+        return *this;
+    }
+};
+
+// Totals for the calling thread since it started.
+AllocationCount allocation_count() noexcept;
+
+/*
+Measures the calling thread's heap activity from construction
+until `count` is called.
+*/
+class AllocationScope
+{
+  public:
+    AllocationScope() noexcept;
+
+    // Activity since this scope was constructed.
+    AllocationCount count() const noexcept;
+
+  protected:
+    AllocationCount begin;
+};
@@ -0,0 +1,262 @@
+/*
+Allocation accounting for the compile, match and lex paths.
+This reports how many heap allocations each operation makes,
+and asserts that none are made by:
+- matching with a frozen or compiled pattern
+- searching, splitting or replacing into a sink with a compiled
+  pattern, after its first search, in byte or UTF-8 mode
+- matching through a manager's scratch once it holds the pattern
+- matching through a result cache
+
+It must be linked with `alloc_counter.o`.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "alloc_counter.hpp"
+#include "corpus.hpp"
+#include "frozen.hpp"
+#include "lexer.hpp"
+#include "match_cache.hpp"
+#include "regex.hpp"
+#include "regex_manager.hpp"
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static RegexManager re_manager;
+
+////////////////////////////////////////////////////////////////
+// Helper function(s)
+
+static void report(const char *const _what,
+                   const AllocationCount &_count,
+                   const uint64_t &_operations)
+{
+    std::cout << _what << ": "
+              << _count.allocations / (double)_operations
+              << " allocations, "
+              << _count.bytes / (double)_operations
+              << " bytes per operation\n";
+}
+
+/*
+Reports allocations for compiling and matching every corpus
+pattern, and asserts that matching through a frozen table, or
+matching, searching, splitting and replacing into a sink with
+a compiled RegEx (on any engine), allocates nothing. The first
+search of each pattern, which builds its search automata, is
+not counted.
+*/
+void test_corpus_allocations()
+{
+    AllocationCount compile, freeze, tokex_match, frozen_match;
+    AllocationCount regex_match_count, regex_search_count;
+    AllocationCount regex_replace_count, scratch_match;
+    AllocationCount cached_match;
+    uint64_t patterns = 0, inputs = 0;
+
+    // Run a match, throwing if it allocated
+    const auto no_allocations = [](const char *_engine,
+                                   const char *_pattern,
+                                   const char *_item,
+                                   const auto &_match) {
+        AllocationScope scope;
+        _match();
+        const AllocationCount used = scope.count();
+        if (used.allocations != 0)
+        {
+            std::cout << _engine << " /" << _pattern << "/ on '"
+                      << _item << "' allocated "
+                      << used.allocations << " times\n";
+            throw std::runtime_error("Match allocated!");
+        }
+        return used;
+    };
+
+    RegexOptions graph_only;
+    graph_only.dense_table_limit = 0;
+    RegexScratch scratch = re_manager.make_scratch();
+
+    for (const auto &c : regex_corpus)
+    {
+        const std::string expanded =
+            re_manager.perform_substitutions(c.pattern);
+
+        AllocationScope compile_scope;
+        RegexGraph pattern =
+            compile_regex_graph(expanded.c_str());
+        compile += compile_scope.count();
+
+        AllocationScope freeze_scope;
+        const FrozenRegex frozen = freeze_regex(pattern);
+        freeze += freeze_scope.count();
+        ++patterns;
+
+        const RegEx chosen = compile_regex(expanded.c_str());
+        const RegEx graph =
+            compile_regex(expanded.c_str(), graph_only);
+        chosen.search("");
+        re_manager.prepare(scratch, c.pattern);
+        MatchCache cache(std::make_shared<const RegEx>(
+                             compile_regex(expanded.c_str())),
+                         64);
+
+        for (const auto &list : {c.should_pass, c.should_fail})
+        {
+            for (const auto &item : list)
+            {
+                AllocationScope tokex_scope;
+                regex_match(pattern, item);
+                tokex_match += tokex_scope.count();
+
+                const char *const name =
+                    regex_engine_name(chosen.engine());
+                frozen_match += no_allocations(
+                    "frozen", c.pattern, item, [&]() {
+                        return regex_match(frozen, item);
+                    });
+                regex_match_count += no_allocations(
+                    name, c.pattern, item, [&]() {
+                        return regex_match(chosen, item);
+                    });
+                regex_match_count += no_allocations(
+                    "graph", c.pattern, item, [&]() {
+                        return regex_match(graph, item);
+                    });
+                scratch_match += no_allocations(
+                    "scratch", c.pattern, item, [&]() {
+                        return re_manager.match(
+                            scratch, c.pattern, item);
+                    });
+                for (int repeat = 0; repeat < 2; ++repeat)
+                {
+                    cached_match += no_allocations(
+                        "cached", c.pattern, item,
+                        [&]() { return cache.match(item); });
+                }
+                regex_search_count += no_allocations(
+                    name, c.pattern, item, [&]() {
+                        return chosen.search(item).has_value();
+                    });
+                regex_search_count += no_allocations(
+                    "graph", c.pattern, item, [&]() {
+                        return graph.search(item).has_value();
+                    });
+                regex_replace_count += no_allocations(
+                    name, c.pattern, item, [&]() {
+                        size_t written = 0;
+                        regex_replace(
+                            chosen, item, "<$&>",
+                            [&](const std::string_view &_s) {
+                                written += _s.size();
+                            });
+                        return written;
+                    });
+                regex_replace_count += no_allocations(
+                    name, c.pattern, item, [&]() {
+                        size_t parts = 0;
+                        for (const auto &part :
+                             regex_split(chosen, item))
+                        {
+                            parts += !part.empty();
+                        }
+                        return parts;
+                    });
+                ++inputs;
+            }
+        }
+    }
+
+    // Guard against the counter not being linked in at all
+    if (compile.allocations == 0)
+    {
+        throw std::runtime_error(
+            "Allocations are not counted!");
+    }
+
+    report("Compile", compile, patterns);
+    report("Freeze", freeze, patterns);
+    report("Tokex match", tokex_match, inputs);
+    report("Frozen match", frozen_match, inputs);
+    report("RegEx match", regex_match_count, 2 * inputs);
+    report("RegEx search", regex_search_count, 2 * inputs);
+    report("Scratch match", scratch_match, inputs);
+    report("Cached match", cached_match, 2 * inputs);
+    report("RegEx replace and split", regex_replace_count,
+           2 * inputs);
+}
+
+/*
+Asserts that stepping over a character after an empty match in
+UTF-8 mode allocates nothing, when splitting, iterating matches
+or replacing into a sink.
+*/
+void test_utf8_allocations()
+{
+    RegexOptions utf8;
+    utf8.utf8 = true;
+    const RegEx pattern = compile_regex("x*", utf8);
+    const std::string text =
+        "a\xC3\xA9x\xE2\x82\xACxx\xF0\x9F\x98\x80\xC3";
+    pattern.search("");
+
+    AllocationScope scope;
+    size_t found = 0;
+    for (const auto &part : regex_split(pattern, text))
+    {
+        found += part.size();
+    }
+    for (const auto &match : regex_matches(pattern, text))
+    {
+        found += match.size() + 1;
+    }
+    regex_replace(pattern, text, "<$&>",
+                  [&](const std::string_view &_s) {
+                      found += _s.size();
+                  });
+    const AllocationCount used = scope.count();
+
+    if (used.allocations != 0 || found == 0)
+    {
+        std::cout << "UTF-8 steps allocated "
+                  << used.allocations << " times\n";
+        throw std::runtime_error("UTF-8 step allocated!");
+    }
+    report("UTF-8 split, matches and replace", used, 3);
+}
+
+/*
+Reports allocations for lexing a short piece of source.
+*/
+void test_lex_allocations()
+{
+    Lexer l;
+    const std::string source =
+        "let x: i32 = 5 + foo(bar, \"s\");";
+    const uint64_t reps = 16;
+
+    AllocationScope scope;
+    for (uint64_t i = 0; i < reps; ++i)
+    {
+        l.lex_l(source);
+    }
+    report("Lex", scope.count(), reps);
+}
+
+////////////////////////////////////////////////////////////////
+// Main function
+
+int main()
+{
+    register_corpus_substitutions(re_manager);
+
+    test_corpus_allocations();
+    test_utf8_allocations();
+    test_lex_allocations();
+
+    std::cout << "All allocation tests passed.\n";
+
+    return 0;
+}
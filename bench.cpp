@@ -0,0 +1,920 @@
+/*
+Benchmark harness for the RegEx engines. For every workload
+(the RegEx test corpus, the corpus again with large inputs
+generated from each automaton, and a family of generated large
+patterns) and every engine, this measures compilation time,
+match throughput and per-match latency percentiles. Searching
+for literals in large texts is timed the same way. It also
+records how compilation time grows with pattern size. The
+`shuffle2` engine matches two copies of each input at once, and
+its rates count both. For the table engines, the size of the
+compiled table is reported beside its speed. The `cached`
+engine puts a result cache before the chosen engine; as every
+pass repeats the same inputs, it shows the cost of a repeat.
+
+Results are printed as a summary table and written as JSON, so
+that runs can be compared across engines and commits. With
+`--counters`, hardware performance counters are also read around
+the compile and match loops, and reported per state compiled and
+per byte matched. Counters which cannot be opened are reported
+as null rather than failing the run.
+
+Usage: ./bench.out [--counters] [output.json]
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "comb.hpp"
+#include "corpus.hpp"
+#include "frozen.hpp"
+#include "input_generator.hpp"
+#include "match_cache.hpp"
+#include "perf_counters.hpp"
+#include "regex.hpp"
+#include "regex_manager.hpp"
+#include "shuffle.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+namespace clk = std::chrono;
+
+////////////////////////////////////////////////////////////////
+// Settings
+
+// Compilations timed per workload (the median is reported).
+static const int compile_reps = 7;
+
+// Passes over the inputs when sampling per-match latency.
+static const int latency_passes = 20;
+
+// Minimum wall time spent on each throughput measurement.
+static const double throughput_min_s = 0.05;
+
+// Inputs longer than this are not given to std::regex, whose
+// recursive executor can overflow the stack on long inputs.
+static const size_t std_regex_max_input = 512;
+
+// Keeps results alive so the optimizer cannot drop a match.
+static volatile uint64_t sink = 0;
+
+// Hardware counters, if requested on the command line.
+static PerfCounters *counters = nullptr;
+
+////////////////////////////////////////////////////////////////
+// Data
+
+// A pattern (already expanded) and the inputs to run it on.
+struct Workload
+{
+    std::string name, pattern;
+    std::vector<std::string> inputs;
+};
+
+// The measurements for one engine on one workload.
+struct Result
+{
+    std::string engine, workload, pattern;
+    long long states = -1, table_bytes = -1;
+    size_t inputs = 0, bytes = 0;
+    double compile_us = 0.0, mb_per_s = 0.0;
+    double strings_per_s = 0.0, p50_ns = 0.0, p99_ns = 0.0;
+
+    // Counter totals, and the work they were measured over
+    PerfReading compile_counters, match_counters;
+    double compiles = 0.0, matched_bytes = 0.0;
+};
+
+// One point on a compile-time curve.
+struct CurvePoint
+{
+    std::string engine, family;
+    size_t size = 0, pattern_bytes = 0;
+    long long states = -1;
+    double compile_us = 0.0;
+};
+
+////////////////////////////////////////////////////////////////
+// Helper function(s)
+
+static double elapsed_us(
+    const clk::steady_clock::time_point &_a,
+    const clk::steady_clock::time_point &_b)
+{
+    return clk::duration<double, std::micro>(_b - _a).count();
+}
+
+// The q-th quantile (0 <= q <= 1) of some samples.
+static double percentile(std::vector<double> _samples,
+                         const double &_q)
+{
+    if (_samples.empty())
+    {
+        return 0.0;
+    }
+
+    size_t i = (size_t)(_q * (_samples.size() - 1) + 0.5);
+    std::nth_element(_samples.begin(), _samples.begin() + i,
+                     _samples.end());
+    return _samples[i];
+}
+
+static std::string json_escape(const std::string &_what)
+{
+    std::ostringstream out;
+    for (const char &c : _what)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            out << "\\u" << std::hex << std::setw(4)
+                << std::setfill('0') << (int)c << std::dec;
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    return out.str();
+}
+
+/*
+Times one engine on one workload. `_compile` returns a compiled
+pattern, and `_match` runs a compiled pattern on one input.
+*/
+template <typename CompileFn, typename MatchFn>
+Result bench_engine(const char *_engine, const Workload &_work,
+                    CompileFn _compile, MatchFn _match)
+{
+    Result out;
+    out.engine = _engine;
+    out.workload = _work.name;
+    out.pattern = _work.pattern;
+    out.inputs = _work.inputs.size();
+    for (const auto &input : _work.inputs)
+    {
+        out.bytes += input.size();
+    }
+
+    // Compilation
+    std::vector<double> compile_samples;
+    if (counters != nullptr)
+    {
+        counters->start();
+    }
+    for (int i = 0; i < compile_reps; ++i)
+    {
+        auto start = clk::steady_clock::now();
+        auto compiled = _compile();
+        auto end = clk::steady_clock::now();
+        compile_samples.push_back(elapsed_us(start, end));
+    }
+    if (counters != nullptr)
+    {
+        out.compile_counters = counters->stop();
+    }
+    out.compile_us = percentile(compile_samples, 0.5);
+    out.compiles = compile_reps;
+
+    auto compiled = _compile();
+
+    // Per-match latency
+    std::vector<double> latencies;
+    latencies.reserve(latency_passes * _work.inputs.size());
+    for (int pass = 0; pass < latency_passes; ++pass)
+    {
+        for (const auto &input : _work.inputs)
+        {
+            auto start = clk::steady_clock::now();
+            sink = sink + _match(compiled, input);
+            auto end = clk::steady_clock::now();
+            latencies.push_back(1000.0 *
+                                elapsed_us(start, end));
+        }
+    }
+    out.p50_ns = percentile(latencies, 0.5);
+    out.p99_ns = percentile(latencies, 0.99);
+
+    // Throughput: whole passes until enough time has elapsed
+    uint64_t passes = 0;
+    double total_us = 0.0;
+    if (counters != nullptr)
+    {
+        counters->start();
+    }
+    auto start = clk::steady_clock::now();
+    do
+    {
+        for (const auto &input : _work.inputs)
+        {
+            sink = sink + _match(compiled, input);
+        }
+        ++passes;
+        total_us = elapsed_us(start, clk::steady_clock::now());
+    } while (total_us < throughput_min_s * 1e6);
+    if (counters != nullptr)
+    {
+        out.match_counters = counters->stop();
+    }
+    out.matched_bytes = (double)passes * out.bytes;
+
+    out.mb_per_s = passes * out.bytes / total_us;
+    out.strings_per_s = 1e6 * passes * out.inputs / total_us;
+
+    return out;
+}
+
+////////////////////////////////////////////////////////////////
+// Engines
+
+static RegexGraph compile_tokex(const std::string &_pattern)
+{
+    return compile_regex_graph(_pattern.c_str());
+}
+
+// Runs every engine on the given workload.
+static void bench_all_engines(const Workload &_work,
+                              std::vector<Result> &_results)
+{
+    Result r = bench_engine(
+        "tokex", _work,
+        [&]() { return compile_tokex(_work.pattern); },
+        [](RegexGraph &_re, const std::string &_input) {
+            return regex_match(_re, _input.c_str());
+        });
+    r.states =
+        compile_tokex(_work.pattern).get_all_nodes().size();
+    _results.push_back(r);
+
+    r = bench_engine(
+        "frozen", _work,
+        [&]() {
+            RegexGraph re = compile_tokex(_work.pattern);
+            return freeze_regex(re);
+        },
+        [](const FrozenRegex &_re, const std::string &_input) {
+            return _re.match(_input);
+        });
+    {
+        RegexGraph re = compile_tokex(_work.pattern);
+        const FrozenRegex frozen = freeze_regex(re);
+        r.states = frozen.state_count();
+        r.table_bytes = frozen.memory_usage().total();
+    }
+    _results.push_back(r);
+
+    // The same table, row-displaced
+    const auto compile_comb = [&]() {
+        RegexGraph re = compile_tokex(_work.pattern);
+        return CombRegex(re);
+    };
+    r = bench_engine("comb", _work, compile_comb,
+                     [](const CombRegex &_re,
+                        const std::string &_input) {
+                         return _re.match(_input);
+                     });
+    {
+        const CombRegex comb = compile_comb();
+        r.states = comb.state_count();
+        r.table_bytes = comb.memory_usage().total();
+    }
+    _results.push_back(r);
+
+    // Byte shuffles, alone and on two copies of each input at
+    // once, for automata small enough
+    const auto compile_shuffle = [&]() {
+        RegexGraph re = compile_tokex(_work.pattern);
+        return ShuffleRegex(freeze_regex(re));
+    };
+    if (r.states <= (long long)ShuffleRegex::max_states)
+    {
+        r = bench_engine(
+            "shuffle", _work, compile_shuffle,
+            [](const ShuffleRegex &_re,
+               const std::string &_input) {
+                return _re.match(_input);
+            });
+        r.states = compile_shuffle().state_count();
+        r.table_bytes =
+            compile_shuffle().memory_usage().total();
+        _results.push_back(r);
+
+        r = bench_engine(
+            "shuffle2", _work, compile_shuffle,
+            [](const ShuffleRegex &_re,
+               const std::string &_input) {
+                const std::string_view both[2] = {_input,
+                                                  _input};
+                bool out[2];
+                _re.match_many(both, 2, out);
+                return out[0] + out[1];
+            });
+        r.mb_per_s *= 2;
+        r.strings_per_s *= 2;
+        r.states = compile_shuffle().state_count();
+        r.table_bytes =
+            compile_shuffle().memory_usage().total();
+        _results.push_back(r);
+    }
+
+    // Whichever engine compile_regex chooses
+    r = bench_engine(
+        "regex", _work,
+        [&]() { return compile_regex(_work.pattern.c_str()); },
+        [](const RegEx &_re, const std::string &_input) {
+            return _re.match(_input);
+        });
+    r.states =
+        compile_regex(_work.pattern.c_str()).state_count();
+    _results.push_back(r);
+
+    // The same, behind a result cache
+    r = bench_engine(
+        "cached", _work,
+        [&]() {
+            return MatchCache(
+                std::make_shared<const RegEx>(
+                    compile_regex(_work.pattern.c_str())),
+                1 << 12);
+        },
+        [](MatchCache &_cache, const std::string &_input) {
+            return _cache.match(_input);
+        });
+    r.states =
+        compile_regex(_work.pattern.c_str()).state_count();
+    _results.push_back(r);
+
+    // The same in UTF-8 mode, which should cost nothing on
+    // these ASCII workloads
+    RegexOptions utf8;
+    utf8.utf8 = true;
+    r = bench_engine(
+        "utf8", _work,
+        [&]() {
+            return compile_regex(_work.pattern.c_str(), utf8);
+        },
+        [](const RegEx &_re, const std::string &_input) {
+            return _re.match(_input);
+        });
+    r.states = compile_regex(_work.pattern.c_str(), utf8)
+                   .state_count();
+    _results.push_back(r);
+
+    // std::regex as a reference point, on inputs it can handle
+    Workload bounded = _work;
+    std::erase_if(bounded.inputs, [](const std::string &_s) {
+        return _s.size() > std_regex_max_input;
+    });
+
+    if (!bounded.inputs.empty())
+    {
+        _results.push_back(bench_engine(
+            "std_regex", bounded,
+            [&]() {
+                return std::regex(_work.pattern,
+                                  std::regex::extended);
+            },
+            [](std::regex &_re, const std::string &_input) {
+                return std::regex_match(_input, _re);
+            }));
+    }
+}
+
+/*
+Times searching for a literal rather than matching it: with the
+literal fast path, with the same literal put on the dense table
+by wrapping it in a group, and with `std::string::find`.
+*/
+static void bench_search(const Workload &_work,
+                         std::vector<Result> &_results)
+{
+    const auto search = [](const RegEx &_re,
+                           const std::string &_input) {
+        return _re.search(_input).has_value();
+    };
+    const std::string grouped = "(" + _work.pattern + ")";
+
+    _results.push_back(bench_engine(
+        "regex", _work,
+        [&]() { return compile_regex(_work.pattern.c_str()); },
+        search));
+    _results.push_back(bench_engine(
+        "dense", _work,
+        [&]() { return compile_regex(grouped.c_str()); },
+        search));
+    _results.push_back(bench_engine(
+        "find", _work, [&]() { return _work.pattern; },
+        [](const std::string &_needle,
+           const std::string &_input) {
+            return _input.find(_needle) != std::string::npos;
+        }));
+}
+
+////////////////////////////////////////////////////////////////
+// Workloads
+
+static std::mt19937 rng(0xb33f);
+
+static std::string random_word(const size_t &_length,
+                               const char *_alphabet)
+{
+    const size_t n = strlen(_alphabet);
+    std::string out;
+    for (size_t i = 0; i < _length; ++i)
+    {
+        out.push_back(_alphabet[rng() % n]);
+    }
+    return out;
+}
+
+// Copy of the input with one byte changed.
+static std::string mutate(std::string _what)
+{
+    if (!_what.empty())
+    {
+        _what[rng() % _what.size()] ^= 0x20;
+    }
+    return _what;
+}
+
+// The RegEx test corpus, expanded through a RegexManager.
+static std::vector<Workload> corpus_workloads()
+{
+    RegexManager manager;
+    register_corpus_substitutions(manager);
+
+    std::vector<Workload> out;
+    for (const auto &c : regex_corpus)
+    {
+        Workload w;
+        w.name = std::string("corpus ") + c.pattern;
+        w.pattern = manager.perform_substitutions(c.pattern);
+        w.inputs.assign(c.should_pass.begin(),
+                        c.should_pass.end());
+        w.inputs.insert(w.inputs.end(), c.should_fail.begin(),
+                        c.should_fail.end());
+        out.push_back(w);
+    }
+    return out;
+}
+
+// The corpus patterns again, with large inputs generated from
+// their automata: accepted strings and near misses of 64 to
+// 1024 bytes.
+static std::vector<Workload> generated_workloads()
+{
+    std::vector<Workload> out;
+    for (const auto &w : corpus_workloads())
+    {
+        RegexGraph pattern = compile_tokex(w.pattern);
+        const FrozenRegex frozen = freeze_regex(pattern);
+        InputGenerator gen(frozen, rng());
+
+        Workload g;
+        g.name = "generated " + w.name.substr(7);
+        g.pattern = w.pattern;
+        for (int i = 0; i < 64; ++i)
+        {
+            for (const auto &input : {gen.accepted(64, 1024),
+                                      gen.near_miss(64, 1024)})
+            {
+                if (input.has_value())
+                {
+                    g.inputs.push_back(*input);
+                }
+            }
+        }
+
+        if (!g.inputs.empty())
+        {
+            out.push_back(g);
+        }
+    }
+    return out;
+}
+
+// An alternation of `_n` random lowercase words.
+static Workload alternation_workload(const size_t &_n)
+{
+    Workload out;
+    std::vector<std::string> words;
+    out.name = "alternation " + std::to_string(_n);
+    out.pattern = "(";
+    for (size_t i = 0; i < _n; ++i)
+    {
+        words.push_back(
+            random_word(3 + rng() % 6, "abcdefghijklmnop"));
+        out.pattern += (i == 0 ? "" : "|") + words.back();
+    }
+    out.pattern += ")";
+
+    for (size_t i = 0; i < 256; ++i)
+    {
+        const auto &w = words[rng() % words.size()];
+        out.inputs.push_back(i % 2 == 0 ? w : mutate(w));
+    }
+    return out;
+}
+
+// A single literal of `_n` bytes.
+static Workload literal_workload(const size_t &_n)
+{
+    Workload out;
+    out.name = "literal " + std::to_string(_n);
+    out.pattern = random_word(_n, "abcdefghijklmnopqrstuvwxyz");
+    out.inputs = {out.pattern, mutate(out.pattern),
+                  out.pattern.substr(0, _n / 2)};
+    return out;
+}
+
+// A literal of `_n` bytes to search for in 16 KiB texts, half
+// of which contain it.
+static Workload search_workload(const size_t &_n)
+{
+    Workload out;
+    out.name = "search " + std::to_string(_n);
+    out.pattern = random_word(_n, "abcdefghijklmnopqrstuvwxyz");
+    for (size_t i = 0; i < 8; ++i)
+    {
+        std::string input =
+            random_word(16 << 10, "abcdefghijklmnopqrstuvwxyz");
+        if (i % 2 == 0)
+        {
+            input.replace(rng() % (input.size() - _n), _n,
+                          out.pattern);
+        }
+        out.inputs.push_back(input);
+    }
+    return out;
+}
+
+// `_n` repetitions of `(a|b)*c`.
+static Workload star_workload(const size_t &_n)
+{
+    Workload out;
+    out.name = "star groups " + std::to_string(_n);
+    for (size_t i = 0; i < _n; ++i)
+    {
+        out.pattern += "(a|b)*c";
+    }
+
+    for (size_t i = 0; i < 16; ++i)
+    {
+        std::string input;
+        for (size_t j = 0; j < _n; ++j)
+        {
+            input += random_word(rng() % 64, "ab") + "c";
+        }
+        out.inputs.push_back(i % 2 == 0 ? input
+                                        : mutate(input));
+    }
+    return out;
+}
+
+/*
+Inputs which are mostly rejected before reaching the automaton:
+long strings missing the `@` every match needs, strings too
+short to match, and one which does match.
+*/
+static Workload rejection_workload(const size_t &_length)
+{
+    Workload out;
+    out.name = "rejection " + std::to_string(_length);
+    out.pattern = "(a|b|c)+@(a|b|c)+.(a|b|c)(a|b|c)";
+    for (size_t i = 0; i < 16; ++i)
+    {
+        out.inputs.push_back(random_word(_length, "abc"));
+        out.inputs.push_back(random_word(i % 4, "abc@"));
+    }
+    out.inputs.push_back(random_word(_length / 2, "abc") +
+                         "@" + random_word(_length / 2, "abc") +
+                         ".ab");
+    return out;
+}
+
+/*
+Long wildcard runs, which the dense table skips through with
+`memchr` rather than stepping through byte by byte.
+*/
+static Workload wildcard_workload(const size_t &_length)
+{
+    const char *const text = "the quick brown fox jumps";
+    Workload out;
+    out.name = "wildcard " + std::to_string(_length);
+    out.pattern = "x.*@.*y";
+    for (size_t i = 0; i < 8; ++i)
+    {
+        const std::string input =
+            "x" + random_word(_length / 2, text) + "@" +
+            random_word(_length / 2, text) + "y";
+        out.inputs.push_back(i % 2 == 0 ? input
+                                        : mutate(input));
+    }
+    return out;
+}
+
+// Long runs of digits against `\d+`.
+static Workload digits_workload(const size_t &_length)
+{
+    RegexManager manager;
+    Workload out;
+    out.name = "digits " + std::to_string(_length);
+    out.pattern = manager.perform_substitutions("\\d+");
+    for (size_t i = 0; i < 8; ++i)
+    {
+        std::string input = random_word(_length, "0123456789");
+        out.inputs.push_back(i % 2 == 0 ? input
+                                        : mutate(input));
+    }
+    return out;
+}
+
+////////////////////////////////////////////////////////////////
+// Compile-time curves
+
+static void compile_curve(const std::string &_family,
+                          Workload (*_make)(const size_t &),
+                          const std::vector<size_t> &_sizes,
+                          std::vector<CurvePoint> &_points)
+{
+    for (const auto &size : _sizes)
+    {
+        const Workload w = _make(size);
+
+        CurvePoint p;
+        p.engine = "tokex";
+        p.family = _family;
+        p.size = size;
+        p.pattern_bytes = w.pattern.size();
+
+        std::vector<double> samples;
+        for (int i = 0; i < compile_reps; ++i)
+        {
+            auto start = clk::steady_clock::now();
+            RegexGraph re = compile_tokex(w.pattern);
+            auto end = clk::steady_clock::now();
+            samples.push_back(elapsed_us(start, end));
+            p.states = re.get_all_nodes().size();
+        }
+        p.compile_us = percentile(samples, 0.5);
+        _points.push_back(p);
+
+        samples.clear();
+        for (int i = 0; i < compile_reps; ++i)
+        {
+            auto start = clk::steady_clock::now();
+            std::regex re(w.pattern, std::regex::extended);
+            auto end = clk::steady_clock::now();
+            samples.push_back(elapsed_us(start, end));
+        }
+        p.engine = "std_regex";
+        p.states = -1;
+        p.compile_us = percentile(samples, 0.5);
+        _points.push_back(p);
+    }
+}
+
+////////////////////////////////////////////////////////////////
+// Output
+
+// Write counter totals divided by some amount of work.
+static void write_counters(std::ostream &_strm,
+                           const PerfReading &_reading,
+                           const char *_unit,
+                           const double &_work)
+{
+    _strm << "{";
+    for (int i = 0; i < number_perf_events; ++i)
+    {
+        _strm << (i == 0 ? "" : ", ") << '"'
+              << perf_event_name((PerfEvent)i) << "_per_"
+              << _unit << "\": ";
+        if (_reading.valid[i] && _work > 0.0)
+        {
+            _strm << _reading.counts[i] / _work;
+        }
+        else
+        {
+            _strm << "null";
+        }
+    }
+    _strm << "}";
+}
+
+static void write_json(std::ostream &_strm,
+                       const std::vector<Result> &_results,
+                       const std::vector<CurvePoint> &_points)
+{
+    _strm << "{\n";
+    if (counters != nullptr)
+    {
+        _strm << "  \"counters_available\": "
+              << (counters->available() ? "true" : "false")
+              << ",\n  \"counters_error\": \""
+              << json_escape(counters->error()) << "\",\n";
+    }
+    _strm << "  \"benchmarks\": [";
+    for (size_t i = 0; i < _results.size(); ++i)
+    {
+        const Result &r = _results[i];
+        _strm << (i == 0 ? "" : ",") << "\n    {"
+              << "\"engine\": \"" << r.engine << "\", "
+              << "\"workload\": \"" << json_escape(r.workload)
+              << "\", "
+              << "\"pattern\": \"" << json_escape(r.pattern)
+              << "\", "
+              << "\"states\": ";
+        if (r.states < 0)
+        {
+            _strm << "null";
+        }
+        else
+        {
+            _strm << r.states;
+        }
+        _strm << ", \"inputs\": " << r.inputs
+              << ", \"bytes\": " << r.bytes
+              << ", \"compile_us\": " << r.compile_us
+              << ", \"mb_per_s\": " << r.mb_per_s
+              << ", \"strings_per_s\": " << r.strings_per_s
+              << ", \"p50_ns\": " << r.p50_ns
+              << ", \"p99_ns\": " << r.p99_ns
+              << ", \"table_bytes\": ";
+        if (r.table_bytes < 0)
+        {
+            _strm << "null";
+        }
+        else
+        {
+            _strm << r.table_bytes;
+        }
+
+        if (counters != nullptr)
+        {
+            _strm << ", \"compile_counters\": ";
+            write_counters(_strm, r.compile_counters, "state",
+                           r.compiles *
+                               std::max(0ll, r.states));
+            _strm << ", \"match_counters\": ";
+            write_counters(_strm, r.match_counters, "byte",
+                           r.matched_bytes);
+        }
+
+        _strm << "}";
+    }
+
+    _strm << "\n  ],\n  \"compile_curves\": [";
+    for (size_t i = 0; i < _points.size(); ++i)
+    {
+        const CurvePoint &p = _points[i];
+        _strm << (i == 0 ? "" : ",") << "\n    {"
+              << "\"engine\": \"" << p.engine << "\", "
+              << "\"family\": \"" << p.family << "\", "
+              << "\"size\": " << p.size
+              << ", \"pattern_bytes\": " << p.pattern_bytes
+              << ", \"states\": ";
+        if (p.states < 0)
+        {
+            _strm << "null";
+        }
+        else
+        {
+            _strm << p.states;
+        }
+        _strm << ", \"compile_us\": " << p.compile_us << "}";
+    }
+    _strm << "\n  ]\n}\n";
+}
+
+static void print_summary(const std::vector<Result> &_results)
+{
+    std::cout << std::left << std::setw(10) << "engine"
+              << std::setw(24) << "workload" << std::right
+              << std::setw(12) << "compile us" << std::setw(10)
+              << "MB/s" << std::setw(12) << "strings/s"
+              << std::setw(10) << "p50 ns" << std::setw(10)
+              << "p99 ns" << std::setw(10) << "table KB"
+              << '\n'
+              << std::fixed << std::setprecision(1);
+
+    for (const auto &r : _results)
+    {
+        std::cout << std::left << std::setw(10) << r.engine
+                  << std::setw(24) << r.workload.substr(0, 23)
+                  << std::right << std::setw(12) << r.compile_us
+                  << std::setw(10) << r.mb_per_s
+                  << std::setw(12) << r.strings_per_s
+                  << std::setw(10) << r.p50_ns << std::setw(10)
+                  << r.p99_ns << std::setw(10);
+        if (r.table_bytes < 0)
+        {
+            std::cout << "-" << '\n';
+        }
+        else
+        {
+            std::cout << r.table_bytes / 1024.0 << '\n';
+        }
+    }
+
+    std::cout << std::defaultfloat;
+}
+
+////////////////////////////////////////////////////////////////
+// Main function
+
+int main(int argc, char *argv[])
+{
+    const char *output_path = nullptr;
+
+    // Only opened when asked for
+    std::optional<PerfCounters> perf;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--counters")
+        {
+            if (!perf)
+            {
+                perf.emplace();
+            }
+            counters = &*perf;
+        }
+        else
+        {
+            output_path = argv[i];
+        }
+    }
+
+    if (counters != nullptr && !counters->available())
+    {
+        std::cerr << "Performance counters unavailable ("
+                  << counters->error()
+                  << "); reporting wall-clock only.\n";
+    }
+
+    std::vector<Workload> workloads = corpus_workloads();
+    for (const auto &w : generated_workloads())
+    {
+        workloads.push_back(w);
+    }
+    for (const size_t n : {16, 128, 1024})
+    {
+        workloads.push_back(alternation_workload(n));
+    }
+    workloads.push_back(literal_workload(256));
+    workloads.push_back(star_workload(32));
+    workloads.push_back(digits_workload(4096));
+    workloads.push_back(rejection_workload(4096));
+    workloads.push_back(wildcard_workload(65536));
+
+    std::vector<Result> results;
+    for (const auto &w : workloads)
+    {
+        bench_all_engines(w, results);
+    }
+    for (const size_t n : {1, 4, 16, 64})
+    {
+        bench_search(search_workload(n), results);
+    }
+
+    std::vector<CurvePoint> points;
+    compile_curve("alternation", alternation_workload,
+                  {4, 8, 16, 32, 64, 128}, points);
+    compile_curve("literal", literal_workload,
+                  {16, 32, 64, 128, 256, 512}, points);
+    compile_curve("star groups", star_workload,
+                  {4, 8, 16, 32, 64, 128}, points);
+
+    print_summary(results);
+
+    if (output_path != nullptr)
+    {
+        std::ofstream file(output_path);
+        if (!file.is_open())
+        {
+            std::cerr << "Failed to open '" << output_path
+                      << "'\n";
+            return 1;
+        }
+        write_json(file, results, points);
+        std::cout << "Wrote " << output_path << '\n';
+    }
+    else
+    {
+        write_json(std::cout, results, points);
+    }
+
+    return 0;
+}
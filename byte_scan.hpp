@@ -0,0 +1,156 @@
+/*
+Scans for the first of two or three bytes, as `memchr` does for
+one, or for the first of three bytes or any byte of 0x80 or
+more. These compare 32 bytes at a time with SSE2 where it is
+available, and fall back to a byte loop otherwise and for the
+tail. The frozen matcher uses them to skip over states which
+read most bytes without leaving.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The first byte in [_first, _last) equal to `_a`, or `_last`.
+inline const unsigned char *memchr1(
+    const unsigned char &_a, const unsigned char *_first,
+    const unsigned char *const _last) noexcept
+{
+    const void *const found =
+        memchr(_first, _a, _last - _first);
+    return found == nullptr ? _last
+                            : (const unsigned char *)found;
+}
+
+// The first byte in [_first, _last) equal to `_a` or `_b`, or
+// `_last`.
+inline const unsigned char *memchr2(
+    const unsigned char &_a, const unsigned char &_b,
+    const unsigned char *_first,
+    const unsigned char *const _last) noexcept
+{
+#ifdef __SSE2__
+    const __m128i a = _mm_set1_epi8((char)_a);
+    const __m128i b = _mm_set1_epi8((char)_b);
+    for (; _last - _first >= 32; _first += 32)
+    {
+        const __m128i lo =
+            _mm_loadu_si128((const __m128i *)_first);
+        const __m128i hi =
+            _mm_loadu_si128((const __m128i *)(_first + 16));
+        const unsigned mask =
+            (unsigned)_mm_movemask_epi8(_mm_or_si128(
+                _mm_cmpeq_epi8(lo, a), _mm_cmpeq_epi8(lo, b))) |
+            (unsigned)_mm_movemask_epi8(_mm_or_si128(
+                _mm_cmpeq_epi8(hi, a), _mm_cmpeq_epi8(hi, b)))
+                << 16;
+        if (mask != 0)
+        {
+            return _first + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; _first != _last; ++_first)
+    {
+        if (*_first == _a || *_first == _b)
+        {
+            return _first;
+        }
+    }
+    return _last;
+}
+
+// The first byte in [_first, _last) equal to `_a`, `_b` or
+// `_c`, or `_last`.
+inline const unsigned char *memchr3(
+    const unsigned char &_a, const unsigned char &_b,
+    const unsigned char &_c, const unsigned char *_first,
+    const unsigned char *const _last) noexcept
+{
+#ifdef __SSE2__
+    const __m128i a = _mm_set1_epi8((char)_a);
+    const __m128i b = _mm_set1_epi8((char)_b);
+    const __m128i c = _mm_set1_epi8((char)_c);
+    const auto any = [&](const __m128i &_v) {
+        return (unsigned)_mm_movemask_epi8(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(_v, a),
+                                      _mm_cmpeq_epi8(_v, b)),
+                         _mm_cmpeq_epi8(_v, c)));
+    };
+    for (; _last - _first >= 32; _first += 32)
+    {
+        const unsigned mask =
+            any(_mm_loadu_si128((const __m128i *)_first)) |
+            any(_mm_loadu_si128(
+                (const __m128i *)(_first + 16)))
+                << 16;
+        if (mask != 0)
+        {
+            return _first + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; _first != _last; ++_first)
+    {
+        if (*_first == _a || *_first == _b || *_first == _c)
+        {
+            return _first;
+        }
+    }
+    return _last;
+}
+
+// The first byte in [_first, _last) equal to `_a`, `_b` or
+// `_c`, or of 0x80 or more, or `_last`.
+inline const unsigned char *memchr_high(
+    const unsigned char &_a, const unsigned char &_b,
+    const unsigned char &_c, const unsigned char *_first,
+    const unsigned char *const _last) noexcept
+{
+#ifdef __SSE2__
+    const __m128i a = _mm_set1_epi8((char)_a);
+    const __m128i b = _mm_set1_epi8((char)_b);
+    const __m128i c = _mm_set1_epi8((char)_c);
+    const auto any = [&](const __m128i &_v) {
+        // The sign bit of each byte is its high bit
+        const __m128i equal =
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(_v, a),
+                                      _mm_cmpeq_epi8(_v, b)),
+                         _mm_cmpeq_epi8(_v, c));
+        return (unsigned)_mm_movemask_epi8(
+            _mm_or_si128(_v, equal));
+    };
+    for (; _last - _first >= 32; _first += 32)
+    {
+        const unsigned mask =
+            any(_mm_loadu_si128((const __m128i *)_first)) |
+            any(_mm_loadu_si128(
+                (const __m128i *)(_first + 16)))
+                << 16;
+        if (mask != 0)
+        {
+            return _first + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; _first != _last; ++_first)
+    {
+        if (*_first >= 0x80 || *_first == _a || *_first == _b ||
+            *_first == _c)
+        {
+            return _first;
+        }
+    }
+    return _last;
+}
@@ -0,0 +1,383 @@
+/*
+A compressed form of a frozen pattern, for automata too large to
+keep as a dense table. Most rows of a large automaton send
+nearly every byte class to the same place, usually the dead
+state, so each row keeps only a default and the entries which
+differ from it. The rows are overlaid into one array by row
+displacement, as yacc and flex do: row `s` begins at `base[s]`,
+and an entry belongs to it only if its `check` names `s`.
+
+Rows can be read straight from a compiled pattern's graph, so
+compressing never needs room for the dense table.
+
+A lookup is still O(1): the class of the byte, the row's base,
+then one entry, and the default if the entry belongs elsewhere.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "frozen.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <vector>
+
+class CombRegex
+{
+  public:
+    // A pattern which matches nothing.
+    CombRegex()
+    {
+        classes.fill(0);
+        rows.resize(1);
+        entries.resize(1);
+        accepting.assign(1, false);
+    }
+
+    // Compress a frozen pattern, which need not outlive this.
+    explicit CombRegex(const FrozenRegex &_from)
+    {
+        const size_t n = _from.state_count();
+        const size_t k = _from.class_count();
+        number_classes = k;
+        for (int b = 0; b < 256; ++b)
+        {
+            classes[b] = _from.byte_class(b);
+        }
+
+        // One byte of each class, to read the table with
+        std::vector<unsigned char> member(k);
+        for (int b = 255; b >= 0; --b)
+        {
+            member[classes[b]] = b;
+        }
+
+        std::vector<std::vector<uint8_t>> differ(n);
+        std::vector<std::vector<uint32_t>> to(n);
+        std::vector<uint32_t> row(k);
+        rows.resize(n);
+        accepting.assign(n, false);
+        for (uint32_t s = 0; s < n; ++s)
+        {
+            for (size_t c = 0; c < k; ++c)
+            {
+                row[c] = _from.next_state(s, member[c]);
+            }
+            compress(s, row, differ[s], to[s]);
+            accepting[s] = _from.is_accepting(s);
+        }
+        start = _from.start_state();
+
+        place(differ, to, k);
+    }
+
+    // Compress a compiled pattern, which is not modified and
+    // need not outlive this. Rows are read from the graph one
+    // at a time, so no dense table is ever built.
+    explicit CombRegex(RegexGraph &_from)
+    {
+        const GraphRows graph(_from);
+        const size_t n = graph.state_count();
+        const size_t k = graph.class_count();
+        number_classes = k;
+        classes = graph.byte_classes();
+
+        std::vector<std::vector<uint8_t>> differ(n);
+        std::vector<std::vector<uint32_t>> to(n);
+        std::vector<uint32_t> row(k);
+        rows.resize(n);
+        accepting.assign(n, false);
+        for (uint32_t s = 0; s < n; ++s)
+        {
+            graph.row(s, row.data());
+            compress(s, row, differ[s], to[s]);
+            accepting[s] = graph.is_accepting(s);
+        }
+        start = graph.start_state();
+
+        place(differ, to, k);
+    }
+
+    // Returns true if and only if all of the given bytes match
+    // the pattern. `_scanned` is set to the number of bytes
+    // examined, which is less than `_length` if the match was
+    // rejected early. This does not allocate.
+    bool match(const char *const _text, const size_t &_length,
+               size_t &_scanned) const noexcept
+    {
+        const unsigned char *const first =
+            (const unsigned char *)_text;
+        uint32_t state = start;
+
+        for (size_t i = 0; i < _length; ++i)
+        {
+            state = step(state, first[i]);
+            if (state == FrozenRegex::dead_state)
+            {
+                _scanned = i + 1;
+                return false;
+            }
+        }
+
+        _scanned = _length;
+        return accepting[state];
+    }
+
+    bool match(const char *const _text,
+               const size_t &_length) const noexcept
+    {
+        size_t scanned;
+        return match(_text, _length, scanned);
+    }
+
+    bool match(const std::string_view &_text) const noexcept
+    {
+        return match(_text.data(), _text.size());
+    }
+
+    // The length of the longest prefix of the given bytes
+    // which the pattern accepts, or `FrozenRegex::npos` if none
+    // is. This does not allocate.
+    size_t longest_prefix(const char *const _text,
+                          const size_t &_length) const noexcept
+    {
+        const unsigned char *const first =
+            (const unsigned char *)_text;
+        uint32_t state = start;
+        size_t out = accepting[state] ? 0 : FrozenRegex::npos;
+
+        for (size_t i = 0; i < _length; ++i)
+        {
+            state = step(state, first[i]);
+            if (state == FrozenRegex::dead_state)
+            {
+                break;
+            }
+            else if (accepting[state])
+            {
+                out = i + 1;
+            }
+        }
+        return out;
+    }
+
+    // The state matching begins in.
+    uint32_t start_state() const noexcept
+    {
+        return start;
+    }
+
+    // The state reached by reading `_byte` in `_state`.
+    uint32_t next_state(
+        const uint32_t &_state,
+        const unsigned char &_byte) const noexcept
+    {
+        return step(_state, _byte);
+    }
+
+    bool is_accepting(const uint32_t &_state) const noexcept
+    {
+        return accepting[_state];
+    }
+
+    // The equivalence class of a byte, as in FrozenRegex.
+    uint8_t byte_class(
+        const unsigned char &_byte) const noexcept
+    {
+        return classes[_byte];
+    }
+
+    // The number of states, including the dead state.
+    size_t state_count() const noexcept
+    {
+        return rows.size();
+    }
+
+    // The number of byte equivalence classes.
+    size_t class_count() const noexcept
+    {
+        return number_classes;
+    }
+
+    // The number of entries in the overlaid array, of which
+    // every row's differing entries take one each.
+    size_t entry_count() const noexcept
+    {
+        return entries.size();
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage out;
+        out.states = rows.capacity() * sizeof(Row) +
+                     accepting.capacity() * sizeof(uint8_t);
+        out.transitions = entries.capacity() * sizeof(Entry);
+        out.auxiliary = sizeof(classes);
+        return out;
+    }
+
+  protected:
+    // Marks an entry which belongs to no row.
+    static constexpr uint32_t unowned = UINT32_MAX;
+
+    struct Row
+    {
+        // Where the row's entries begin in `entries`.
+        uint32_t base = 0;
+
+        // The state for classes with no entry of their own.
+        uint32_t fallback = FrozenRegex::dead_state;
+    };
+
+    struct Entry
+    {
+        uint32_t check = unowned;
+        uint32_t next = FrozenRegex::dead_state;
+    };
+
+    uint32_t step(const uint32_t &_state,
+                  const unsigned char &_byte) const noexcept
+    {
+        const Row &row = rows[_state];
+        const Entry &e = entries[row.base + classes[_byte]];
+        return e.check == _state ? e.next : row.fallback;
+    }
+
+    // Set the default of row `_state` to the commonest state
+    // in `_row`, and list the classes which differ from it.
+    void compress(const uint32_t &_state,
+                  const std::vector<uint32_t> &_row,
+                  std::vector<uint8_t> &_differ,
+                  std::vector<uint32_t> &_to)
+    {
+        std::map<uint32_t, size_t> counts;
+        for (const uint32_t &next : _row)
+        {
+            ++counts[next];
+        }
+        rows[_state].fallback =
+            std::max_element(
+                counts.begin(), counts.end(),
+                [](const auto &_a, const auto &_b) {
+                    return _a.second < _b.second;
+                })
+                ->first;
+
+        for (size_t c = 0; c < _row.size(); ++c)
+        {
+            if (_row[c] != rows[_state].fallback)
+            {
+                _differ.push_back(c);
+                _to.push_back(_row[c]);
+            }
+        }
+    }
+
+    // Give each row the lowest base at which its entries land
+    // on free slots, fullest rows first. Only bases which put a
+    // row's first entry on a free slot are tried, and runs of
+    // taken slots are skipped in one step, so the probing stays
+    // close to linear in the entries. Rows with no entries all
+    // share base 0. The array is padded so that every row's
+    // full width is in bounds.
+    void place(const std::vector<std::vector<uint8_t>> &_differ,
+               const std::vector<std::vector<uint32_t>> &_to,
+               const size_t &_k)
+    {
+        std::vector<uint32_t> order(rows.size());
+        for (size_t s = 0; s < order.size(); ++s)
+        {
+            order[s] = s;
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [&](const uint32_t &_a,
+                             const uint32_t &_b) {
+                             return _differ[_a].size() >
+                                    _differ[_b].size();
+                         });
+
+        // skip[i] leads towards the first free slot at or after
+        // i. Every slot past its end is free.
+        std::vector<size_t> skip;
+        const auto first_free = [&](size_t _i) {
+            size_t out = _i;
+            while (out < skip.size() && skip[out] != out)
+            {
+                out = skip[out];
+            }
+            while (_i != out)
+            {
+                const size_t next = skip[_i];
+                skip[_i] = out;
+                _i = next;
+            }
+            return out;
+        };
+
+        for (const uint32_t &s : order)
+        {
+            if (_differ[s].empty())
+            {
+                rows[s].base = 0;
+                continue;
+            }
+
+            const size_t lowest = _differ[s].front();
+            size_t slot = first_free(lowest);
+            while (!fits(_differ[s], slot - lowest))
+            {
+                slot = first_free(slot + 1);
+            }
+
+            const size_t base = slot - lowest;
+            rows[s].base = base;
+            if (entries.size() < base + _k)
+            {
+                entries.resize(base + _k);
+                for (size_t i = skip.size(); i < base + _k; ++i)
+                {
+                    skip.push_back(i);
+                }
+            }
+            for (size_t i = 0; i < _differ[s].size(); ++i)
+            {
+                const size_t at = base + _differ[s][i];
+                entries[at] = {s, _to[s][i]};
+                skip[at] = at + 1;
+            }
+        }
+        if (entries.size() < _k)
+        {
+            entries.resize(_k);
+        }
+        entries.shrink_to_fit();
+    }
+
+    // Whether a row's entries land only on free slots at
+    // `_base`.
+    bool fits(const std::vector<uint8_t> &_differ,
+              const size_t &_base) const noexcept
+    {
+        for (const uint8_t &c : _differ)
+        {
+            if (_base + c < entries.size() &&
+                entries[_base + c].check != unowned)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::array<uint8_t, 256> classes;
+    std::vector<Row> rows;
+    std::vector<Entry> entries;
+    std::vector<uint8_t> accepting;
+    uint32_t start = FrozenRegex::dead_state;
+    size_t number_classes = 1;
+};
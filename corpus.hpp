@@ -0,0 +1,101 @@
+/*
+The shared corpus of RegEx patterns and inputs. This is used by
+both the RegEx tests and the benchmark harness, so that the
+patterns being timed are the patterns being verified.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "regex_manager.hpp"
+#include <vector>
+
+////////////////////////////////////////////////////////////////
+// Regex Macros
+
+#define H "(a|b|c|d|e|f|A|B|C|D|E|F|0|1|2|3|4|5|6|7|8|9)"
+#define O "(0|1|2|3|4|5|6|7)"
+
+#define HEX_RE "0(x|X)(" H "+')*" H "+"
+#define OCTAL_RE "(0|0(" O "+')*" O "+)"
+#define BINARY_RE "0(b|B)((0|1)+')*(0|1)+"
+#define DECIMAL_RE "-?(1|2|3|4|5|6|7|8|9)(\\d+')*\\d+"
+
+#define INT_RE "(#{hex}|#{dec}|#{oct}|#{bin})"
+
+////////////////////////////////////////////////////////////////
+
+// A pattern alongside inputs it should and should not match.
+struct CorpusCase
+{
+    const char *pattern;
+    std::vector<const char *> should_pass, should_fail;
+};
+
+// Register the int literal substitutions used by the corpus.
+inline void register_corpus_substitutions(
+    RegexManager &_manager)
+{
+    _manager.register_substitution("#{bin}", BINARY_RE);
+    _manager.register_substitution("#{oct}", OCTAL_RE);
+    _manager.register_substitution("#{dec}", DECIMAL_RE);
+    _manager.register_substitution("#{hex}", HEX_RE);
+}
+
+inline const std::vector<CorpusCase> regex_corpus = {
+    {"a*b+c?d", {"bbd", "aaaabcd"}, {"aaacd", "abc"}},
+
+    {"\\d+", {"123", "09876"}, {"", "123abc"}},
+
+    {"\\w+", {"foobar", "BobErt"}, {"greg123"}},
+
+    {"\\w+\\s\\w+",
+     {"foo bbbar", "BobErt ROCKS"},
+     {"foobar", "foo ", " foo", "greg 123"}},
+
+    // Email example
+    {"(\\w|\\d)+@\\w+\\.\\w+",
+     {"jdehmel@outlook.com", "a@b.c"},
+     {"jdehmel@foobar@outlook.com", "1@2.c.d",
+      "jedehmel@ outlook. com"}},
+
+    // Testing basics used for int literals
+    {"(0+1)+", {"01001000101001"}, {"0100110011"}},
+    {"((0|1)+')*", {"11001100'1010'"}, {"11001100'101''"}},
+    {"(1+')*0+", {"1'1'11'11'00"}, {"'11'00", "11'"}},
+
+    // Parshal int literal testing
+    {BINARY_RE,
+     {"0b1111'0000'1111'0000", "0B01011010101", "0b101010'1'1"},
+     {"b1111'0000", "0v1111'0000", "0b1000'2011"}},
+
+    {OCTAL_RE,
+     {"01'234'567'654", "0", "01'2'3"},
+     {"012345678", "01234567'", "0'1'2'3"}},
+
+    {DECIMAL_RE,
+     {"10", "-123", "516", "-9999", "-19'92"},
+     {"0", "-0", "12349A"}},
+
+    {HEX_RE,
+     {"0x12'34'56'67'9A'bC'dd'ee'FF", "0x0"},
+     {"0xG", "0x"}},
+
+    // Int literal example
+    {INT_RE,
+     {"123", "0123", "0x123", "0B1010'1010'1", "100", "0x0",
+      "201", "200"},
+     {"foo", "0xGorilla", "'0101010'", "0x", "0b", "", "char",
+      "0b1010'1002", "0xx0", "0xG", "10.0", "100 0"}},
+};
+
+// The macros above are only for this file
+#undef H
+#undef O
+#undef HEX_RE
+#undef OCTAL_RE
+#undef BINARY_RE
+#undef DECIMAL_RE
+#undef INT_RE
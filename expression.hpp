@@ -17,11 +17,19 @@ $>name          - Pipe memory onto variable
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <list>
 #include <map>
 #include <queue>
 #include <set>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 // Ensure constraints will work
 static_assert(__cplusplus >= 2020'00L, "Please use -std=c++20");
@@ -72,7 +80,7 @@ enum NodeType
 };
 
 // Returns true if the machine is completed, false otherwise.
-static inline const bool state_to_bool(const NodeType &state)
+inline bool state_to_bool(const NodeType &state)
 {
     return state == end;
 }
@@ -95,258 +103,630 @@ class Node
 ////////////////////////////////////////////////////////////////
 
 /*
-Helper type used for compilation. This does NOT take ownership
-of its nodes, and may not even have a complete list of them!
+Approximate number of heap bytes held by a compiled machine.
+Node-based containers are estimated using the usual libstdc++
+layouts (a red-black tree node carries a color and three
+pointers, a list node carries two pointers), so these are
+estimates rather than exact allocator figures.
 */
-template <typename T> class Expression
+struct MemoryUsage
 {
-  public:
-    Node<T> *first;
+    // Bytes used by the state objects themselves.
+    size_t states = 0;
+
+    // Bytes used by transition table entries.
+    size_t transitions = 0;
 
-    // Appends another expression onto the end of this one. In
-    // order for this not to cause a memory leak, `last` should
-    // be nullptr. A partially constructed expression will use
-    // nullptr ONLY to denote end.
-    void knit_other_onto_end(const Expression<T> &_other);
+    // Bytes used by bookkeeping, memory and variables.
+    size_t auxiliary = 0;
 
-    // Union
-    void add_other_as_suit(const Expression<T> &_other);
+    inline size_t total() const noexcept
+    {
+        return states + transitions + auxiliary;
+    }
 
-    // Removes epsilon transitions via closure
-    void remove_epsilons();
+    inline MemoryUsage &operator+=(const MemoryUsage &_other)
+    {
+        states += _other.states;
+        transitions += _other.transitions;
+        auxiliary += _other.auxiliary;
+        return *this;
+    }
 };
 
+// Estimated overhead of a single std::map / std::set node.
+static constexpr size_t tree_node_overhead =
+    4 * sizeof(void *);
+
+// Estimated overhead of a single std::list node.
+static constexpr size_t list_node_overhead =
+    2 * sizeof(void *);
+
 ////////////////////////////////////////////////////////////////
 
+// Token types whose tokens are bytes, held in `data`. `T::byte`
+// makes a token which names exactly one byte, never the
+// wildcard (see TokexChar).
+template <typename T>
+concept ByteToken = requires(const T &_t) {
+    { T::byte(_t.data) } -> std::same_as<T>;
+};
+
+// Settings for building an Nfa.
+struct NfaOptions
+{
+    // Read the wildcard as any one UTF-8 encoded character,
+    // NUL included as in byte mode, and the bytes of a
+    // character as one item, so that `é*` repeats the whole
+    // character. Only byte tokens support this.
+    bool utf8 = false;
+
+    // Match each ASCII letter in the pattern in either case,
+    // by giving it a transition on both. Only byte tokens
+    // support this.
+    bool fold_case = false;
+};
+
 /*
-Helper function for knitting two expressions together.
+Helper type used for compilation: an epsilon-NFA built from a
+pattern by Thompson's construction. Every subexpression becomes
+a fragment with one entry and one exit state, and operators join
+fragments with epsilon transitions. States are numbered in the
+order they are made, so building is deterministic.
+
+In UTF-8 mode, the wildcard becomes a small automaton over
+bytes, with one path per run of encodings whose bytes each
+span a range. Paths share the states which finish them, as
+every 3-byte character from U+1000 to U+CFFF does.
 */
-template <typename T>
-void knit_recursive(Node<T> *_target, Node<T> *_cur,
-                    std::set<Node<T> *> &_visited)
+template <typename T> class Nfa
 {
-    for (auto &link : _cur->next)
+  public:
+    struct State
+    {
+        // Transitions which read a token.
+        std::vector<std::pair<T, size_t>> next;
+
+        // Transitions which read nothing.
+        std::vector<size_t> epsilons;
+    };
+
+    // Throws std::runtime_error if the pattern is malformed.
+    explicit Nfa(const std::vector<T> &_pattern,
+                 const NfaOptions &_options = NfaOptions());
+
+    // The states reachable from `_from` by epsilon transitions
+    // alone, including `_from` themselves, in ascending order.
+    std::vector<size_t> closure(
+        const std::vector<size_t> &_from) const;
+
+    std::vector<State> states;
+
+    // The entry state, and the only accepting state.
+    size_t first = 0, last = 0;
+
+  protected:
+    struct Fragment
     {
-        if (link.second == nullptr)
+        size_t first, last;
+    };
+
+    size_t add_state();
+    void link(const size_t &_from, const size_t &_to);
+
+    // Either of several fragments.
+    Fragment disjunction(const std::vector<T> &_pattern,
+                         size_t &_i);
+
+    // Fragments one after another, up to a disjunction or the
+    // end of a subexpression.
+    Fragment sequence(const std::vector<T> &_pattern,
+                      size_t &_i);
+
+    // A fragment under `?`, `*` or `+`.
+    Fragment repeat(const Fragment &_what, const T &_op);
+
+    // A single token, or in UTF-8 mode the rest of the
+    // character `_cur` begins.
+    Fragment literal(const T &_cur,
+                     const std::vector<T> &_pattern,
+                     size_t &_i);
+
+    // The wildcard.
+    Fragment wildcard();
+
+    // Each code point from `_lo` to `_hi` which is a character,
+    // encoded in UTF-8.
+    Fragment utf8_range(const uint32_t &_lo,
+                        const uint32_t &_hi);
+
+    // A transition from `_from` to `_to` on each byte from
+    // `_lo` to `_hi`.
+    void link_bytes(const size_t &_from, const uint8_t &_lo,
+                    const uint8_t &_hi, const size_t &_to);
+
+    NfaOptions options;
+};
+
+// The byte ranges of each encoding of a run of code points, one
+// range per byte. In each run, every byte after the first spans
+// a range of its own, as a suffix-sharing automaton needs.
+typedef std::vector<std::pair<uint8_t, uint8_t>> Utf8Sequence;
+
+inline void utf8_sequences(uint32_t _lo, uint32_t _hi,
+                           std::vector<Utf8Sequence> &_out)
+{
+    // Surrogates are not characters
+    if (_lo < 0xD800 && _hi > 0xDFFF)
+    {
+        utf8_sequences(_lo, 0xD7FF, _out);
+        utf8_sequences(0xE000, _hi, _out);
+        return;
+    }
+    else if (_lo >= 0xD800 && _lo <= 0xDFFF)
+    {
+        _lo = 0xE000;
+    }
+    else if (_hi >= 0xD800 && _hi <= 0xDFFF)
+    {
+        _hi = 0xD7FF;
+    }
+    if (_lo > _hi)
+    {
+        return;
+    }
+
+    // Split where the length of the encoding changes
+    for (const uint32_t max : {0x7Fu, 0x7FFu, 0xFFFFu})
+    {
+        if (_lo <= max && max < _hi)
         {
-            _cur->next[link.first] = _target;
+            utf8_sequences(_lo, max, _out);
+            utf8_sequences(max + 1, _hi, _out);
+            return;
         }
-        else if (!_visited.contains(link.second))
+    }
+
+    const size_t length = _hi <= 0x7F     ? 1
+                          : _hi <= 0x7FF  ? 2
+                          : _hi <= 0xFFFF ? 3
+                                          : 4;
+
+    // Split until each trailing byte spans whole ranges
+    for (size_t i = 1; i < length; ++i)
+    {
+        const uint32_t m = (1u << (6 * i)) - 1;
+        if ((_lo & ~m) != (_hi & ~m))
         {
-            _visited.insert(link.second);
-            knit_recursive(_target, link.second, _visited);
+            if ((_lo & m) != 0)
+            {
+                utf8_sequences(_lo, _lo | m, _out);
+                utf8_sequences((_lo | m) + 1, _hi, _out);
+                return;
+            }
+            else if ((_hi & m) != m)
+            {
+                utf8_sequences(_lo, (_hi & ~m) - 1, _out);
+                utf8_sequences(_hi & ~m, _hi, _out);
+                return;
+            }
         }
     }
+
+    // The leading byte holds what the trailing bytes do not
+    static const uint8_t lead_marks[] = {0, 0, 0xC0, 0xE0,
+                                         0xF0};
+    Utf8Sequence out(length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        const size_t shift = 6 * (length - 1 - i);
+        const uint8_t mark = i == 0 ? lead_marks[length] : 0x80;
+        const uint32_t mask =
+            i == 0 ? 0xFF >> (length + 1) : 0x3F;
+        out[i] = {(uint8_t)(mark | ((_lo >> shift) & mask)),
+                  (uint8_t)(mark | ((_hi >> shift) & mask))};
+    }
+    if (length == 1)
+    {
+        out[0] = {(uint8_t)_lo, (uint8_t)_hi};
+    }
+    _out.push_back(out);
 }
 
-/*
-Recursively replaces all instances of `nullptr` with the root
-of the other expression, causing the other to be knitted onto
-the end of this expression.
-*/
-template <typename T>
-void Expression<T>::knit_other_onto_end(
-    const Expression<T> &_other)
+// The length of the UTF-8 character which the `_available`
+// bytes at `_bytes` begin with, or 0 if they begin with none.
+// Surrogates and longer encodings than needed are not valid.
+// This never allocates, so it may be used while matching.
+inline size_t utf8_character(const uint8_t *const _bytes,
+                             const size_t &_available) noexcept
 {
-    std::set<Node<T> *> used = {_other.first};
-    knit_recursive(_other.first, first, used);
+    const size_t length = _bytes[0] < 0x80   ? 1
+                          : _bytes[0] < 0xC0 ? 0
+                          : _bytes[0] < 0xE0 ? 2
+                          : _bytes[0] < 0xF0 ? 3
+                          : _bytes[0] < 0xF8 ? 4
+                                             : 0;
+    if (length == 0 || length > _available)
+    {
+        return 0;
+    }
+
+    uint32_t code =
+        _bytes[0] & (length == 1 ? 0x7F : 0x7F >> length);
+    for (size_t i = 1; i < length; ++i)
+    {
+        if ((_bytes[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+        code = (code << 6) | (_bytes[i] & 0x3F);
+    }
+
+    // The least code which needs each length
+    static constexpr uint32_t least[] = {0, 0, 0x80, 0x800,
+                                         0x10000};
+    const bool surrogate = code >= 0xD800 && code <= 0xDFFF;
+    return code < least[length] || code > 0x10FFFF || surrogate
+               ? 0
+               : length;
 }
 
-/*
-Recursive disjunction call.
+////////////////////////////////////////////////////////////////
 
-If _mine.next and _theirs.next is nullptr:
-    Both are already success
-    No change needed; Exit
+template <typename T>
+Nfa<T>::Nfa(const std::vector<T> &_pattern,
+            const NfaOptions &_options)
+    : options(_options)
+{
+    if (options.utf8 && !ByteToken<T>)
+    {
+        throw std::runtime_error(
+            "UTF-8 mode needs byte tokens.");
+    }
+    else if (options.fold_case && !ByteToken<T>)
+    {
+        throw std::runtime_error(
+            "Case folding needs byte tokens.");
+    }
 
-If _mine.next is nullptr but _theirs.next is not:
-    Existing graph finishes here, other does not
-    Epsilon into rest of _theirs
-    Exit
+    size_t i = 0;
+    const Fragment whole = disjunction(_pattern, i);
 
-If _theirs.next is nullptr but _mine.next is not:
-    Existing graph goes on, other ends here
-    Epsilon into success
+    // Only a closing token stops a disjunction early
+    if (i != _pattern.size())
+    {
+        throw std::runtime_error(
+            "Unmatched closing subexpression token.");
+    }
+
+    first = whole.first;
+    last = whole.last;
+}
 
-Else
-    Traditional recursion here
-*/
 template <typename T>
-void suit_add_recursive(Node<T> *_mine, Node<T> *_theirs)
+std::vector<size_t> Nfa<T>::closure(
+    const std::vector<size_t> &_from) const
 {
-    assert(_mine != nullptr && _theirs != nullptr);
+    std::vector<bool> seen(states.size(), false);
+    std::vector<size_t> to_visit = _from;
+    for (const size_t &s : _from)
+    {
+        seen[s] = true;
+    }
 
-    // For each transition in _theirs->next
-    for (const auto &t : _theirs->next)
+    std::vector<size_t> out;
+    while (!to_visit.empty())
     {
-        // If already has this transition
-        if (_mine->next.contains(t.first))
-        {
-            // `m` is my next transition, `o` is theirs.
-            Node<T> *m = _mine->next[t.first], *o = t.second;
+        const size_t cur = to_visit.back();
+        to_visit.pop_back();
+        out.push_back(cur);
 
-            if (m == nullptr && o == nullptr)
+        for (const size_t &s : states[cur].epsilons)
+        {
+            if (!seen[s])
             {
-                // No change needed; Exit
-                return;
+                seen[s] = true;
+                to_visit.push_back(s);
             }
-            else if (m == nullptr || o == nullptr)
-            {
-                /*
-                Epsilon to the remainder of _theirs
-                */
+        }
+    }
 
-                Node<T> *cur = _mine;
-                while (cur->next.contains(T::epsilon()))
-                {
-                    cur = cur->next[T::epsilon()];
-                }
+    std::sort(out.begin(), out.end());
+    return out;
+}
 
-                cur->next[T::epsilon()] = o;
-                return;
+template <typename T> size_t Nfa<T>::add_state()
+{
+    states.emplace_back();
+    return states.size() - 1;
+}
+
+template <typename T>
+void Nfa<T>::link(const size_t &_from, const size_t &_to)
+{
+    states[_from].epsilons.push_back(_to);
+}
+
+/*
+(beg) -eps-> (option 1) -eps-> (end)
+(beg) -eps-> (option 2) -eps-> (end)
+...
+*/
+template <typename T>
+typename Nfa<T>::Fragment Nfa<T>::disjunction(
+    const std::vector<T> &_pattern, size_t &_i)
+{
+    std::vector<Fragment> options = {sequence(_pattern, _i)};
+    while (_i < _pattern.size() &&
+           T::is_disjunction(_pattern[_i]))
+    {
+        ++_i;
+        options.push_back(sequence(_pattern, _i));
+    }
+
+    if (options.size() == 1)
+    {
+        return options.front();
+    }
+
+    const Fragment out = {add_state(), add_state()};
+    for (const auto &option : options)
+    {
+        link(out.first, option.first);
+        link(option.last, out.last);
+    }
+    return out;
+}
+
+/*
+(item 1) -eps-> (item 2) -eps-> ...
+*/
+template <typename T>
+typename Nfa<T>::Fragment Nfa<T>::sequence(
+    const std::vector<T> &_pattern, size_t &_i)
+{
+    std::vector<Fragment> items;
+    while (_i < _pattern.size() &&
+           !T::is_disjunction(_pattern[_i]) &&
+           !T::is_subexpr_close(_pattern[_i]))
+    {
+        const T &cur = _pattern[_i++];
+
+        if (T::is_escape(cur))
+        {
+            // (beg) -next token-> (end)
+            if (_i == _pattern.size())
+            {
+                throw std::runtime_error(
+                    "Escape token at end of pattern.");
             }
 
-            // Neither are nullptr; Traditional recursion
+            // Byte tokens read an escaped byte exactly, so that
+            // `\.` is only a dot
+            const T &escaped = _pattern[_i++];
+            if constexpr (ByteToken<T>)
+            {
+                const T exact = T::byte(escaped.data);
+                items.push_back(literal(exact, _pattern, _i));
+            }
             else
             {
-                // Advance recursively
-                suit_add_recursive(m, o);
+                items.push_back(literal(escaped, _pattern, _i));
             }
         }
-
-        // Otherwise, trivial case
+        else if (T::is_subexpr_open(cur))
+        {
+            items.push_back(disjunction(_pattern, _i));
+            if (_i == _pattern.size())
+            {
+                throw std::runtime_error(
+                    "Unmatched opening subexpression token.");
+            }
+            ++_i;
+        }
+        else if (T::is_optional(cur) || T::is_star(cur) ||
+                 T::is_plus(cur))
+        {
+            if (items.empty())
+            {
+                throw std::runtime_error(
+                    "Repetition token with nothing to repeat.");
+            }
+            items.back() = repeat(items.back(), cur);
+        }
+        else if (T::is_wildcard(cur))
+        {
+            items.push_back(wildcard());
+        }
         else
         {
-            // Add remaining of _theirs directly as next
-            _mine->next[t.first] = t.second;
-            return;
+            items.push_back(literal(cur, _pattern, _i));
         }
     }
+
+    if (items.empty())
+    {
+        const size_t s = add_state();
+        return {s, s};
+    }
+
+    for (size_t j = 1; j < items.size(); ++j)
+    {
+        link(items[j - 1].last, items[j].first);
+    }
+    return {items.front().first, items.back().last};
 }
 
 /*
-Perform the union of the two expressions, such that either this
-or other will lead to the next expression.
+...?
+(beg) -eps-> (...) -eps-> (end)
+(beg) -eps-> (end)
+
+...*
+(beg) -eps-> (...) -eps-> (end)
+(beg) -eps-> (end)
+(...) -eps-> (...)
+
+...+
+(...) -eps-> (end)
+(...) -eps-> (...)
 */
 template <typename T>
-void Expression<T>::add_other_as_suit(
-    const Expression<T> &_other)
+typename Nfa<T>::Fragment Nfa<T>::repeat(const Fragment &_what,
+                                        const T &_op)
 {
-    suit_add_recursive(first, _other.first);
+    if (T::is_plus(_op))
+    {
+        const Fragment out = {_what.first, add_state()};
+        link(_what.last, _what.first);
+        link(_what.last, out.last);
+        return out;
+    }
+
+    const Fragment out = {add_state(), add_state()};
+    link(out.first, _what.first);
+    link(out.first, out.last);
+    link(_what.last, out.last);
+    if (T::is_star(_op))
+    {
+        link(_what.last, _what.first);
+    }
+    return out;
 }
 
 /*
-Performs epsilon closure on the given graph.
+(beg) -token-> (end)
+
+In UTF-8 mode, a character of several bytes is read whole:
+(beg) -lead byte-> (...) -continuation byte-> ... (end)
+
+When folding case, a letter is read in either case:
+(beg) -a or A-> (end)
 */
-template <typename T> void Expression<T>::remove_epsilons()
+template <typename T>
+typename Nfa<T>::Fragment Nfa<T>::literal(
+    const T &_cur, const std::vector<T> &_pattern, size_t &_i)
 {
-    std::set<Node<T> *> all_nodes;
-    std::queue<Node<T> *> to_visit;
-    all_nodes.insert(first);
-    to_visit.push(first);
-
-    // Collect nodes
-    while (!to_visit.empty())
+    const Fragment out = {add_state(), add_state()};
+    if constexpr (ByteToken<T>)
     {
-        Node<T> *cur = to_visit.front();
-        to_visit.pop();
-
-        for (const auto &p : cur->next)
+        const uint8_t lead = _cur.data;
+        if (options.utf8 && lead >= 0x80)
         {
-            if (!all_nodes.contains(p.second))
+            // The lead byte and every continuation byte after
+            std::vector<uint8_t> bytes = {lead};
+            while (bytes.size() < 4 && _i < _pattern.size() &&
+                   ((uint8_t)_pattern[_i].data & 0xC0) == 0x80)
             {
-                all_nodes.insert(p.second);
-                to_visit.push(p.second);
+                bytes.push_back(_pattern[_i++].data);
             }
+
+            const size_t length =
+                utf8_character(bytes.data(), bytes.size());
+            if (length != bytes.size())
+            {
+                throw std::runtime_error(
+                    "Invalid UTF-8 in pattern.");
+            }
+
+            size_t from = out.first;
+            for (size_t i = 0; i < length; ++i)
+            {
+                const size_t to =
+                    i + 1 == length ? out.last : add_state();
+                link_bytes(from, bytes[i], bytes[i], to);
+                from = to;
+            }
+            return out;
+        }
+        else if (options.utf8)
+        {
+            link_bytes(out.first, lead, lead, out.last);
+        }
+        else
+        {
+            states[out.first].next.push_back({_cur, out.last});
         }
-    }
 
-    // Close each node
-    for (const auto &node : all_nodes)
-    {
-        close_node(node);
+        // The other case shares the same target, so the two
+        // usually fall into one byte class and cost nothing
+        const uint8_t lower = lead | 0x20;
+        if (options.fold_case && lower >= 'a' && lower <= 'z')
+        {
+            const uint8_t other = lead ^ 0x20;
+            link_bytes(out.first, other, other, out.last);
+        }
+        return out;
     }
-}
 
-////////////////////////////////////////////////////////////////
+    states[out.first].next.push_back({_cur, out.last});
+    return out;
+}
 
 /*
-This will erase epsilon transitions and return a set of links
-which should be added out of a given node in order to maintain
-functionality.
+(beg) -wildcard-> (end)
+
+In UTF-8 mode, this is instead every character, as bytes.
 */
-template <typename T> void close_node(Node<T> *_cur)
+template <typename T>
+typename Nfa<T>::Fragment Nfa<T>::wildcard()
 {
-    if (_cur != nullptr && _cur->next.contains(T::epsilon()))
+    if constexpr (ByteToken<T>)
     {
-        // Find all nodes reachable by only epsilons from this
-        // node. Also erase epsilon transitions while we are
-        // here.
-        std::set<Node<T> *> closure;
-        std::queue<Node<T> *> to_visit;
-        to_visit.push(_cur);
-
-        while (!to_visit.empty())
+        if (options.utf8)
         {
-            Node<T> *cur = to_visit.front();
-            to_visit.pop();
-
-            // If has not been visited so far
-            if (cur != nullptr &&
-                cur->next.contains(T::epsilon()) &&
-                !closure.contains(cur->next[T::epsilon()]))
-            {
-                // Add to closure and visiting list
-                closure.insert(cur->next[T::epsilon()]);
-                to_visit.push(cur->next[T::epsilon()]);
+            return utf8_range(0, 0x10FFFF);
+        }
+    }
 
-                // Remove epsilon link SAFELY
+    const Fragment out = {add_state(), add_state()};
+    states[out.first].next.push_back(
+        {T(T::wildcard()), out.last});
+    return out;
+}
 
-                // Adopt type
-                if (cur->next[T::epsilon()]->type != normal)
-                {
-                    cur->type = cur->next[T::epsilon()]->type;
-                }
+template <typename T>
+typename Nfa<T>::Fragment Nfa<T>::utf8_range(
+    const uint32_t &_lo, const uint32_t &_hi)
+{
+    std::vector<Utf8Sequence> sequences;
+    utf8_sequences(_lo, _hi, sequences);
 
-                cur->next.erase(T::epsilon());
-            }
-        }
+    // The state which reads a range of bytes into a state,
+    // shared by every sequence which ends that way
+    std::map<std::tuple<uint8_t, uint8_t, size_t>, size_t>
+        suffixes;
 
-        // Merge everything
-        for (const auto &node : closure)
+    const Fragment out = {add_state(), add_state()};
+    for (const Utf8Sequence &sequence : sequences)
+    {
+        size_t to = out.last;
+        for (size_t i = sequence.size() - 1; i > 0; --i)
         {
-            for (const auto &edge : node->next)
+            const auto key = std::make_tuple(
+                sequence[i].first, sequence[i].second, to);
+            auto it = suffixes.find(key);
+            if (it == suffixes.end())
             {
-                if (_cur->next.contains(edge.first))
-                {
-                    // Prevents infinite loop
-                    if (_cur->next[edge.first] == _cur &&
-                        edge.second == node)
-                    {
-                        continue;
-                    }
-
-                    // Recursive case
-                    // Add epsilon linkage between the two
-                    // candidates, then recurse.
-
-                    // Add linkage
-                    Node<T> *cursor = _cur->next[edge.first];
-                    while (cursor->next.contains(T::epsilon()))
-                    {
-                        cursor = cursor->next[T::epsilon()];
-                    }
-                    cursor->next[T::epsilon()] = edge.second;
-
-                    // Recurse
-                    close_node(_cur->next[edge.first]);
-                }
-                else
-                {
-                    // Normal case
-                    _cur->next[edge.first] = edge.second;
-                }
+                const size_t from = add_state();
+                link_bytes(from, sequence[i].first,
+                           sequence[i].second, to);
+                it = suffixes.emplace(key, from).first;
             }
+            to = it->second;
         }
+        link_bytes(out.first, sequence[0].first,
+                   sequence[0].second, to);
+    }
+    return out;
+}
+
+template <typename T>
+void Nfa<T>::link_bytes(const size_t &_from, const uint8_t &_lo,
+                        const uint8_t &_hi, const size_t &_to)
+{
+    for (unsigned b = _lo; b <= _hi; ++b)
+    {
+        states[_from].next.push_back({T::byte((char)b), _to});
     }
 }
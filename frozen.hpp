@@ -0,0 +1,795 @@
+/*
+A frozen form of a compiled pattern. Compilation produces a
+graph of heap-allocated nodes whose transitions live in
+`std::map`s, and matching it walks a `std::list` of characters.
+Freezing flattens that graph into a dense transition table over
+byte equivalence classes, so that matching is a single table
+lookup per byte and never touches the heap.
+
+States which read most bytes without leaving, such as the body
+of `.*@`, are accelerated: freezing records the one to three
+bytes which leave them, and matching jumps straight to the next
+of those with `memchr`, `memchr2` or `memchr3` rather than
+stepping through the run a byte at a time. In UTF-8 mode, the
+body of `.*` leaves on every byte of a multi-byte character, so
+such states may also stop at any byte of 0x80 or more.
+
+When there are few enough classes, a stride-2 table is also
+built, indexed by a state and the classes of two bytes. Matching
+then makes one dependent load per pair of bytes rather than per
+byte, and finishes an odd tail with the ordinary table.
+
+Inside the tables, a state is stored premultiplied by the length
+of a row, so that a step is one add and one load. States are
+laid out in ranges: the dead state, then plain states, then
+accelerated states, then accepting states (those both
+accelerated and accepting come between), so that each flag is a
+single comparison against the id. The public interface numbers
+states from 0 as usual.
+
+Ids are stored in the narrowest of 8, 16 or 32 bits which holds
+them all, chosen separately for each table, and the match loop
+is instantiated for each width. Most patterns fit in 8 or 16
+bits, which keeps many more of them in cache at once.
+
+Freezing does not change what a pattern matches: each byte
+follows its own transition if there is one, then the wildcard
+transition, exactly as in `Tokex::run`.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "byte_scan.hpp"
+#include "regex_graph.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+// The states of a compiled pattern and its byte classes, from
+// which a table is built one row at a time. State 0 is the dead
+// state and the nodes are numbered from 1. Bytes which lead to
+// the same state from every state share a class. The classes
+// are refined node by node, so that building them needs no
+// scratch wider than one row.
+class GraphRows
+{
+  public:
+    explicit GraphRows(RegexGraph &_from)
+    {
+        const std::list<Node<TokexChar> *> all =
+            _from.get_all_nodes();
+        nodes.assign(all.begin(), all.end());
+        for (Node<TokexChar> *node : nodes)
+        {
+            const uint32_t id = ids.size() + 1;
+            ids[node] = id;
+        }
+
+        // Split each class by where its bytes lead from each
+        // node. Ids go by first byte, as for whole columns.
+        classes.fill(0);
+        size_t count = 1;
+        for (const Node<TokexChar> *node : nodes)
+        {
+            std::map<std::pair<uint8_t, uint32_t>, uint8_t>
+                split;
+            for (int b = 0; b < 256; ++b)
+            {
+                const auto key =
+                    std::make_pair(classes[b], target(node, b));
+                auto it = split.find(key);
+                if (it == split.end())
+                {
+                    const uint8_t id = split.size();
+                    it = split.emplace(key, id).first;
+                }
+                classes[b] = it->second;
+            }
+            count = split.size();
+        }
+
+        // One byte of each class, to read the graph with
+        members.resize(count);
+        for (int b = 255; b >= 0; --b)
+        {
+            members[classes[b]] = b;
+        }
+    }
+
+    // The number of states, including the dead state.
+    size_t state_count() const noexcept
+    {
+        return nodes.size() + 1;
+    }
+
+    size_t class_count() const noexcept
+    {
+        return members.size();
+    }
+
+    const std::array<uint8_t, 256> &byte_classes()
+        const noexcept
+    {
+        return classes;
+    }
+
+    // The state matching begins in.
+    uint32_t start_state() const noexcept
+    {
+        return nodes.empty() ? 0 : 1;
+    }
+
+    bool is_accepting(const uint32_t &_state) const noexcept
+    {
+        return _state != 0 &&
+               state_to_bool(nodes[_state - 1]->type);
+    }
+
+    // Write where each class leads from `_state` to `_row`,
+    // which has room for `class_count()` states.
+    void row(const uint32_t &_state, uint32_t *const _row) const
+    {
+        for (size_t c = 0; c < members.size(); ++c)
+        {
+            _row[c] = _state == 0 ? 0
+                                  : target(nodes[_state - 1],
+                                           members[c]);
+        }
+    }
+
+  protected:
+    // The state `_byte` leads to from `_node`: its own
+    // transition if there is one, then the wildcard transition,
+    // exactly as in `Tokex::run`.
+    uint32_t target(const Node<TokexChar> *const _node,
+                    const unsigned char &_byte) const
+    {
+        auto it = _node->next.find(TokexChar::byte(_byte));
+        if (it == _node->next.end())
+        {
+            it = _node->next.find(TokexChar::wildcard());
+        }
+        return it == _node->next.end() ? 0 : ids.at(it->second);
+    }
+
+    std::vector<Node<TokexChar> *> nodes;
+    std::map<const Node<TokexChar> *, uint32_t> ids;
+    std::array<uint8_t, 256> classes;
+    std::vector<unsigned char> members;
+};
+
+class FrozenRegex
+{
+  public:
+    // The state with no way out. Every other state is reachable
+    // from the start state.
+    static constexpr uint32_t dead_state = 0;
+
+    // Returned by `longest_prefix` when nothing matches.
+    static constexpr size_t npos = std::string_view::npos;
+
+    // The largest stride-2 table built by default, in bytes.
+    static constexpr size_t default_stride_limit = 1 << 15;
+
+    FrozenRegex()
+    {
+        classes.fill(0);
+        table = std::vector<uint8_t>(1, dead_state);
+    }
+
+    // Flatten an already compiled pattern. The pattern is not
+    // modified, and need not outlive the frozen copy. A
+    // stride-2 table is built if it fits in `_stride_limit`
+    // bytes.
+    explicit FrozenRegex(
+        RegexGraph &_from,
+        const size_t &_stride_limit = default_stride_limit)
+    {
+        const GraphRows graph(_from);
+        classes = graph.byte_classes();
+        number_classes = graph.class_count();
+
+        // The table by node number, before laying it out
+        const size_t n = graph.state_count();
+        std::vector<uint32_t> next(n * number_classes);
+        std::vector<bool> accepting(n, false);
+        for (uint32_t s = 0; s < n; ++s)
+        {
+            graph.row(s, &next[s * number_classes]);
+            accepting[s] = graph.is_accepting(s);
+        }
+
+        const std::vector<uint32_t> wide =
+            lay_out(next, accepting, find_escapes(next));
+        table = narrow(wide);
+        if (stride_table_bytes() <= _stride_limit)
+        {
+            pairs = narrow(build_pairs(wide));
+        }
+    }
+
+    // Returns true if and only if all of the given bytes match
+    // the pattern. `_scanned` is set to the number of bytes
+    // examined, which is less than `_length` if the match was
+    // rejected early. This does not allocate.
+    bool match(const char *const _text, const size_t &_length,
+               size_t &_scanned) const noexcept
+    {
+        return std::visit(
+            [&](const auto &_table, const auto &_pairs) {
+                return match_with(
+                    _table.data(),
+                    _pairs.empty() ? nullptr : _pairs.data(),
+                    _text, _length, _scanned);
+            },
+            table, pairs);
+    }
+
+    bool match(const char *const _text,
+               const size_t &_length) const noexcept
+    {
+        size_t scanned;
+        return match(_text, _length, scanned);
+    }
+
+    bool match(const std::string_view &_text) const noexcept
+    {
+        return match(_text.data(), _text.size());
+    }
+
+    bool match(const char *const _text) const noexcept
+    {
+        return match(_text, strlen(_text));
+    }
+
+    // The length of the longest prefix of the given bytes
+    // which the pattern accepts, or `npos` if none is. This
+    // stops at the first dead state and does not allocate.
+    size_t longest_prefix(const char *const _text,
+                          const size_t &_length) const noexcept
+    {
+        return std::visit(
+            [&](const auto &_table) {
+                return longest_prefix_with(_table.data(), _text,
+                                           _length);
+            },
+            table);
+    }
+
+    // The state matching begins in.
+    uint32_t start_state() const noexcept
+    {
+        return start / number_classes;
+    }
+
+    // The state reached by reading `_byte` in `_state`.
+    uint32_t next_state(
+        const uint32_t &_state,
+        const unsigned char &_byte) const noexcept
+    {
+        return entry(table, _state * number_classes +
+                                classes[_byte]) /
+               number_classes;
+    }
+
+    bool is_accepting(const uint32_t &_state) const noexcept
+    {
+        return _state * number_classes >= accepting_begin;
+    }
+
+    // The equivalence class of a byte. Bytes of the same class
+    // lead to the same state from every state.
+    uint8_t byte_class(
+        const unsigned char &_byte) const noexcept
+    {
+        return classes[_byte];
+    }
+
+    // The number of states, including the dead state.
+    size_t state_count() const noexcept
+    {
+        return entries(table) / number_classes;
+    }
+
+    // The number of byte equivalence classes.
+    size_t class_count() const noexcept
+    {
+        return number_classes;
+    }
+
+    // The bytes used to store each state id in the table: 1, 2
+    // or 4.
+    size_t id_width() const noexcept
+    {
+        return width(table);
+    }
+
+    // The bytes needed for ids in a table of `_entries`
+    // entries, which hold premultiplied ids below that.
+    static size_t id_bytes(const size_t &_entries) noexcept
+    {
+        return _entries <= UINT8_MAX + 1    ? 1
+               : _entries <= UINT16_MAX + 1 ? 2
+                                            : 4;
+    }
+
+    // Whether matching skips ahead while in `_state`.
+    bool is_accelerated(const uint32_t &_state) const noexcept
+    {
+        return _state * number_classes - accelerated_begin <
+               accelerated_span;
+    }
+
+    // The bytes below 0x80 which leave an accelerated state, or
+    // nothing if every such byte loops back to it.
+    std::string_view escape_bytes(
+        const uint32_t &_state) const noexcept
+    {
+        if (!is_accelerated(_state))
+        {
+            return {};
+        }
+        const size_t id = _state * number_classes;
+        const Escapes &e =
+            escapes[(id - accelerated_begin) / number_classes];
+        return std::string_view((const char *)e.bytes.data(),
+                                e.count);
+    }
+
+    // Whether skipping through an accelerated state stops at
+    // every byte of 0x80 or more. Otherwise, the escape bytes
+    // are all which leave it.
+    bool escapes_high_bytes(
+        const uint32_t &_state) const noexcept
+    {
+        if (!is_accelerated(_state))
+        {
+            return false;
+        }
+        const size_t id = _state * number_classes;
+        const Escapes &e =
+            escapes[(id - accelerated_begin) / number_classes];
+        return e.high;
+    }
+
+    // The number of accelerated states.
+    size_t accelerated_count() const noexcept
+    {
+        return escapes.size();
+    }
+
+    // The number of bytes consumed per lookup: 2 if a stride-2
+    // table was built, otherwise 1.
+    size_t stride() const noexcept
+    {
+        return entries(pairs) == 0 ? 1 : 2;
+    }
+
+    // The size of the stride-2 table, whether or not it was
+    // built.
+    size_t stride_table_bytes() const noexcept
+    {
+        const size_t n = entries(table) * number_classes;
+        return n * id_bytes(n);
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage out;
+        out.states = escapes.capacity() * sizeof(Escapes);
+        out.transitions = capacity_bytes(table) +
+                          capacity_bytes(pairs);
+        out.auxiliary = sizeof(classes);
+        return out;
+    }
+
+  protected:
+    // A table of premultiplied state ids, in one of three
+    // widths.
+    typedef std::variant<std::vector<uint8_t>,
+                         std::vector<uint16_t>,
+                         std::vector<uint32_t>>
+        IdTable;
+
+    // `_wide` in the narrowest width which holds every id below
+    // its size.
+    static IdTable narrow(const std::vector<uint32_t> &_wide)
+    {
+        switch (id_bytes(_wide.size()))
+        {
+        case 1:
+            return std::vector<uint8_t>(_wide.begin(),
+                                        _wide.end());
+        case 2:
+            return std::vector<uint16_t>(_wide.begin(),
+                                         _wide.end());
+        default:
+            return _wide;
+        }
+    }
+
+    static uint32_t entry(const IdTable &_table,
+                          const size_t &_i) noexcept
+    {
+        return std::visit(
+            [&](const auto &_t) -> uint32_t { return _t[_i]; },
+            _table);
+    }
+
+    static size_t entries(const IdTable &_table) noexcept
+    {
+        return std::visit(
+            [](const auto &_t) { return _t.size(); }, _table);
+    }
+
+    static size_t width(const IdTable &_table) noexcept
+    {
+        return std::visit(
+            [](const auto &_t) { return sizeof(_t[0]); },
+            _table);
+    }
+
+    static size_t capacity_bytes(const IdTable &_table) noexcept
+    {
+        return std::visit(
+            [](const auto &_t) {
+                return _t.capacity() * sizeof(_t[0]);
+            },
+            _table);
+    }
+
+    // `match`, for tables of the given widths. `_pairs` is
+    // nullptr if there is no stride-2 table.
+    template <typename T, typename P>
+    bool match_with(const T *const _table,
+                    const P *const _pairs,
+                    const char *const _text,
+                    const size_t &_length,
+                    size_t &_scanned) const noexcept
+    {
+        const unsigned char *const first =
+            (const unsigned char *)_text;
+        const unsigned char *const last = first + _length;
+        const unsigned char *ptr = first;
+        uint32_t state = start;
+
+        if (_pairs != nullptr)
+        {
+            // In the stride-2 table, states are premultiplied
+            // by the square of the number of classes
+            const size_t k = number_classes;
+            uint32_t pair_state = state * k;
+            for (; last - ptr >= 2; ptr += 2)
+            {
+                if (pair_state - pair_accelerated_begin <
+                    pair_accelerated_span)
+                {
+                    ptr = skip(pair_state / k, ptr, last);
+                    if (last - ptr < 2)
+                    {
+                        break;
+                    }
+                }
+
+                const uint32_t before = pair_state;
+                pair_state = _pairs[pair_state +
+                                    classes[ptr[0]] * k +
+                                    classes[ptr[1]]];
+                if (pair_state == dead_state)
+                {
+                    // Which byte of the pair was rejected
+                    const bool first_dead =
+                        _table[before / k + classes[ptr[0]]] ==
+                        dead_state;
+                    _scanned =
+                        ptr - first + (first_dead ? 1 : 2);
+                    return false;
+                }
+            }
+            state = pair_state / k;
+        }
+
+        for (; ptr != last; ++ptr)
+        {
+            if (state - accelerated_begin < accelerated_span)
+            {
+                ptr = skip(state, ptr, last);
+                if (ptr == last)
+                {
+                    break;
+                }
+            }
+
+            state = _table[state + classes[*ptr]];
+            if (state == dead_state)
+            {
+                _scanned = ptr - first + 1;
+                return false;
+            }
+        }
+
+        _scanned = _length;
+        return state >= accepting_begin;
+    }
+
+    // `longest_prefix`, for a table of the given width.
+    template <typename T>
+    size_t longest_prefix_with(
+        const T *const _table, const char *const _text,
+        const size_t &_length) const noexcept
+    {
+        const unsigned char *const first =
+            (const unsigned char *)_text;
+        uint32_t state = start;
+        size_t out = state >= accepting_begin ? 0 : npos;
+
+        for (size_t i = 0; i < _length; ++i)
+        {
+            // Every prefix ending within an accepting run is
+            // accepted
+            if (state - accelerated_begin < accelerated_span)
+            {
+                i = skip(state, first + i, first + _length) -
+                    first;
+                if (state >= accepting_begin)
+                {
+                    out = i;
+                }
+                if (i == _length)
+                {
+                    break;
+                }
+            }
+
+            state = _table[state + classes[first[i]]];
+            if (state == dead_state)
+            {
+                break;
+            }
+            else if (state >= accepting_begin)
+            {
+                out = i + 1;
+            }
+        }
+
+        return out;
+    }
+
+    // States left by more bytes than this are not accelerated.
+    static constexpr size_t max_escapes = 3;
+
+    // The bytes which leave an accelerated state.
+    struct Escapes
+    {
+        uint8_t count = 0;
+        std::array<unsigned char, max_escapes> bytes = {};
+
+        // Whether every byte of 0x80 or more is also an escape.
+        bool high = false;
+    };
+
+    // The escapes of each live state in the table `_next`, by
+    // node number, if there are few enough of them.
+    std::vector<std::optional<Escapes>> find_escapes(
+        const std::vector<uint32_t> &_next) const
+    {
+        const size_t n = _next.size() / number_classes;
+        std::vector<std::optional<Escapes>> out(n);
+
+        for (uint32_t s = 1; s < n; ++s)
+        {
+            Escapes e;
+            size_t count = 0;
+            for (int b = 0; b < 256 && count <= max_escapes;
+                 ++b)
+            {
+                if (_next[s * number_classes + classes[b]] !=
+                        s &&
+                    count++ < max_escapes)
+                {
+                    e.bytes[count - 1] = b;
+                }
+            }
+
+            if (count <= max_escapes)
+            {
+                e.count = count;
+                out[s] = e;
+                continue;
+            }
+
+            // Failing that, stop at every byte of 0x80 or more
+            e.high = true;
+            count = 0;
+            for (int b = 0; b < 0x80 && count <= max_escapes;
+                 ++b)
+            {
+                if (_next[s * number_classes + classes[b]] !=
+                        s &&
+                    count++ < max_escapes)
+                {
+                    e.bytes[count - 1] = b;
+                }
+            }
+
+            if (count <= max_escapes)
+            {
+                e.count = count;
+                out[s] = e;
+            }
+        }
+        return out;
+    }
+
+    // Renumber the states of `_next` into their ranges, and
+    // return the table of premultiplied ids.
+    std::vector<uint32_t> lay_out(
+        const std::vector<uint32_t> &_next,
+        const std::vector<bool> &_accepting,
+        const std::vector<std::optional<Escapes>> &_escapes)
+    {
+        const size_t k = number_classes;
+        const size_t n = _accepting.size();
+
+        // Plain, accelerated, both, then accepting
+        const auto range = [&](const size_t &_s) {
+            if (_s == dead_state)
+            {
+                return 0;
+            }
+            const bool fast = _escapes[_s].has_value();
+            return _accepting[_s] ? (fast ? 3 : 4)
+                                  : (fast ? 2 : 1);
+        };
+        std::vector<uint32_t> order(n);
+        for (size_t s = 0; s < n; ++s)
+        {
+            order[s] = s;
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [&](const uint32_t &_a,
+                             const uint32_t &_b) {
+                             return range(_a) < range(_b);
+                         });
+
+        std::vector<uint32_t> id(n);
+        escapes.clear();
+        accelerated_begin = accepting_begin = n * k;
+        for (size_t i = n; i-- > 0;)
+        {
+            const uint32_t s = order[i];
+            id[s] = i * k;
+            if (_escapes[s].has_value())
+            {
+                accelerated_begin = i * k;
+            }
+            if (_accepting[s])
+            {
+                accepting_begin = i * k;
+            }
+        }
+        for (const uint32_t &s : order)
+        {
+            if (_escapes[s].has_value())
+            {
+                escapes.push_back(*_escapes[s]);
+            }
+        }
+        accelerated_span = escapes.size() * k;
+        if (escapes.empty())
+        {
+            accelerated_begin = 0;
+        }
+
+        std::vector<uint32_t> out(n * k, dead_state);
+        for (size_t s = 0; s < n; ++s)
+        {
+            for (size_t c = 0; c < k; ++c)
+            {
+                out[id[s] + c] = id[_next[s * k + c]];
+            }
+        }
+        start = id[1];
+        return out;
+    }
+
+    // The stride-2 table for the table `_table`. Its states are
+    // premultiplied by the square of the number of classes.
+    std::vector<uint32_t> build_pairs(
+        const std::vector<uint32_t> &_table)
+    {
+        const size_t k = number_classes;
+        std::vector<uint32_t> out(_table.size() * k,
+                                  dead_state);
+        for (size_t s = 0; s < _table.size(); s += k)
+        {
+            for (size_t a = 0; a < k; ++a)
+            {
+                const uint32_t mid = _table[s + a];
+                for (size_t b = 0; b < k; ++b)
+                {
+                    out[(s + a) * k + b] = _table[mid + b] * k;
+                }
+            }
+        }
+        pair_accelerated_begin = accelerated_begin * k;
+        pair_accelerated_span = accelerated_span * k;
+        return out;
+    }
+
+    // The first byte in [_ptr, _last) which leaves accelerated
+    // state `_state`, or `_last`.
+    const unsigned char *skip(
+        const uint32_t &_state, const unsigned char *_ptr,
+        const unsigned char *const _last) const noexcept
+    {
+        const Escapes &e =
+            escapes[(_state - accelerated_begin) /
+                    number_classes];
+        if (e.high)
+        {
+            // Unused escapes repeat a high byte
+            return memchr_high(e.count > 0 ? e.bytes[0] : 0x80,
+                               e.count > 1 ? e.bytes[1] : 0x80,
+                               e.count > 2 ? e.bytes[2] : 0x80,
+                               _ptr, _last);
+        }
+        switch (e.count)
+        {
+        case 0:
+            return _last;
+        case 1:
+            return memchr1(e.bytes[0], _ptr, _last);
+        case 2:
+            return memchr2(e.bytes[0], e.bytes[1], _ptr, _last);
+        default:
+            return memchr3(e.bytes[0], e.bytes[1], e.bytes[2],
+                           _ptr, _last);
+        }
+    }
+
+    // The equivalence class of each byte.
+    std::array<uint8_t, 256> classes;
+    size_t number_classes = 1;
+
+    // table[state + class] is the next state, where states are
+    // premultiplied by `number_classes`.
+    IdTable table;
+    uint32_t start = dead_state;
+
+    // The ranges of accelerated and of accepting states. The
+    // accepting range runs to the end of the table.
+    uint32_t accelerated_begin = 0, accelerated_span = 0;
+    uint32_t accepting_begin = 1;
+
+    // The escapes of each accelerated state, in order.
+    std::vector<Escapes> escapes;
+
+    // pairs[state + first class * number_classes + second
+    // class] is the state after both bytes, or the table is
+    // empty.
+    IdTable pairs;
+    uint32_t pair_accelerated_begin = 0;
+    uint32_t pair_accelerated_span = 0;
+};
+
+// Freeze a compiled pattern. See FrozenRegex.
+inline FrozenRegex freeze_regex(RegexGraph &_pattern)
+{
+    return FrozenRegex(_pattern);
+}
+
+inline bool regex_match(const FrozenRegex &_pattern,
+                        const char *_text)
+{
+    return _pattern.match(_text);
+}
@@ -0,0 +1,681 @@
+/*
+Differential and performance fuzzing for the RegEx engines.
+
+Random patterns are drawn from the grammar `compile_regex`
+supports (literals, `.`, escapes, parenthesized alternation and
+the `*`, `+` and `?` globs), along with random inputs. Each
+input is matched by every internal engine, which must all agree
+with Tokex, and by `std::regex` (POSIX extended), which Tokex
+should agree with. It is also searched, where the spans found by
+the chosen engine must be those the graph engine finds by trying
+each start. Compilation and match times are recorded so
+that outliers, such as subset construction blowups in
+`Tokex::determinize`, can be found before users find them.
+
+Two builds are supported:
+
+- By default (`make fuzz`), cases come from a seeded generator:
+  `./fuzz.out [cases] [seed]`. Each case runs in a forked child,
+  so a crash or a hang is reported as a finding rather than
+  ending the run. Findings are minimized before printing, and
+  the exit code is nonzero if there were any.
+- With `-DTOKEX_LIBFUZZER -fsanitize=fuzzer` (`make
+  fuzz-libfuzzer`, needs clang), libFuzzer's input bytes drive
+  the same generator, and any disagreement aborts. Use
+  libFuzzer's `-timeout` flag to catch slow compiles.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "regex.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+namespace clk = std::chrono;
+
+#if !defined(TOKEX_LIBFUZZER) && defined(__unix__)
+#define FUZZ_FORK
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////////
+// Settings
+
+// Deepest nesting of parenthesized subexpressions.
+static const int max_depth = 2;
+
+// Inputs tried per pattern, and their longest length.
+static const int inputs_per_case = 24;
+static const int max_input_length = 12;
+
+// Seconds a forked case may run before it counts as a hang.
+static const unsigned case_timeout_s = 2;
+
+// A case is an outlier if its time per byte exceeds the median
+// by this factor.
+static const double outlier_factor = 25.0;
+
+// Findings of each kind printed (and minimized) per run, and
+// the seconds spent minimizing each.
+static const size_t max_reports = 5;
+static const double minimize_budget_s = 10.0;
+
+// Stack given to forked cases, so runaway recursion is caught
+// quickly.
+static const size_t case_stack_bytes = 1 << 20;
+
+////////////////////////////////////////////////////////////////
+// Generation
+
+/*
+A source of choices: either a seeded PRNG, or the bytes given by
+libFuzzer (which run out, after which every choice is zero).
+*/
+class Choices
+{
+  public:
+    Choices(const uint64_t &_seed) : rng(_seed)
+    {
+    }
+
+    Choices(const uint8_t *_data, const size_t &_size)
+        : data(_data), size(_size)
+    {
+    }
+
+    // A value in [0, _n).
+    unsigned below(const unsigned &_n)
+    {
+        if (data == nullptr)
+        {
+            return rng() % _n;
+        }
+        else if (pos < size)
+        {
+            return data[pos++] % _n;
+        }
+        return 0;
+    }
+
+  protected:
+    std::mt19937_64 rng;
+    const uint8_t *data = nullptr;
+    size_t size = 0, pos = 0;
+};
+
+// Bytes literals are drawn from. Inputs also use `c`, which
+// patterns never mention.
+static const char *const literals = "ab0";
+static const char *const escapable = "()|*+?.";
+
+static std::string generate_pattern(Choices &_c,
+                                    const int &_depth)
+{
+    std::string out;
+    const unsigned atoms = 1 + _c.below(4);
+
+    for (unsigned i = 0; i < atoms; ++i)
+    {
+        const unsigned kind = _c.below(12);
+        if (kind < 6)
+        {
+            out.push_back(literals[_c.below(3)]);
+        }
+        else if (kind < 7)
+        {
+            out.push_back('.');
+        }
+        else if (kind < 8)
+        {
+            out.push_back('\\');
+            out.push_back(escapable[_c.below(7)]);
+        }
+        else if (_depth > 0)
+        {
+            const unsigned branches = 1 + _c.below(3);
+            out.push_back('(');
+            for (unsigned j = 0; j < branches; ++j)
+            {
+                out += (j == 0 ? "" : "|") +
+                       generate_pattern(_c, _depth - 1);
+            }
+            out.push_back(')');
+        }
+        else
+        {
+            out.push_back(literals[_c.below(3)]);
+        }
+
+        const unsigned glob = _c.below(8);
+        if (glob < 3)
+        {
+            out.push_back("*+?"[glob]);
+        }
+    }
+
+    return out;
+}
+
+static std::string generate_input(Choices &_c,
+                                  const std::string &_pattern)
+{
+    // Mostly bytes from the pattern, so that matches happen
+    std::string out;
+    const unsigned length = _c.below(max_input_length + 1);
+    for (unsigned i = 0; i < length; ++i)
+    {
+        if (_c.below(8) == 0)
+        {
+            out.push_back('c');
+        }
+        else
+        {
+            char b = _pattern[_c.below(_pattern.size())];
+            out.push_back(b == '\\' ? 'a' : b);
+        }
+    }
+    return out;
+}
+
+// Whether a pattern is in the generated grammar: balanced, with
+// no empty alternatives, no glob without an atom before it, no
+// double globs, and escaping only `escapable` bytes. Used to
+// keep minimized patterns meaningful.
+static bool in_grammar(const std::string &_pattern)
+{
+    int depth = 0;
+    bool atom = false, globbed = false;
+
+    for (size_t i = 0; i < _pattern.size(); ++i)
+    {
+        const char c = _pattern[i];
+        if (c == '\\')
+        {
+            if (i + 1 == _pattern.size() ||
+                strchr(escapable, _pattern[i + 1]) == nullptr)
+            {
+                return false;
+            }
+            ++i;
+            atom = true, globbed = false;
+        }
+        else if (c == '(' || c == '|')
+        {
+            if (c == '|' && (!atom || depth == 0))
+            {
+                return false;
+            }
+            depth += c == '(';
+            atom = false, globbed = false;
+        }
+        else if (c == ')')
+        {
+            if (!atom || --depth < 0)
+            {
+                return false;
+            }
+            globbed = false;
+        }
+        else if (c == '*' || c == '+' || c == '?')
+        {
+            if (!atom || globbed)
+            {
+                return false;
+            }
+            globbed = true;
+        }
+        else
+        {
+            atom = true, globbed = false;
+        }
+    }
+
+    return depth == 0 && atom;
+}
+
+////////////////////////////////////////////////////////////////
+// Running cases
+
+// What went wrong with a case, from least to most severe.
+enum Finding
+{
+    found_nothing,
+    found_reference, // Tokex disagrees with std::regex
+    found_internal,  // Internal engines disagree with Tokex
+    found_error,     // Compiling a valid pattern threw
+    found_timeout,   // Compiling or matching hung
+    found_crash,     // Compiling or matching crashed
+};
+
+static const char *const finding_names[] = {
+    "nothing",
+    "std::regex disagrees",
+    "engines disagree",
+    "compile error",
+    "timeout",
+    "crash",
+};
+
+/*
+The outcome of one pattern and its inputs: the worst finding,
+with a description, and timings if the case finished.
+*/
+struct CaseResult
+{
+    Finding finding = found_nothing;
+    std::string detail;
+    double compile_us = 0.0, match_ns_per_byte = 0.0;
+};
+
+static std::string describe(const std::string &_input,
+                            const char *_engine,
+                            const bool &_got,
+                            const bool &_expected)
+{
+    std::ostringstream out;
+    out << "on '" << _input << "' " << _engine << " says "
+        << _got << ", expected " << _expected;
+    return out.str();
+}
+
+/*
+Compile a pattern and run every engine on every input. Internal
+engines are checked against Tokex, and Tokex against std::regex.
+*/
+static CaseResult run_case(
+    const std::string &_pattern,
+    const std::vector<std::string> &_inputs)
+{
+    CaseResult out;
+    RegexOptions graph_only;
+    graph_only.dense_table_limit = 0;
+    RegEx graph;
+
+    auto start = clk::steady_clock::now();
+    try
+    {
+        graph = compile_regex(_pattern.c_str(), graph_only);
+    }
+    catch (const std::exception &e)
+    {
+        out.finding = found_error;
+        out.detail = e.what();
+        return out;
+    }
+    auto end = clk::steady_clock::now();
+    out.compile_us =
+        clk::duration<double, std::micro>(end - start).count();
+
+    RegexGraph &tokex = graph.graph();
+    const FrozenRegex frozen = freeze_regex(tokex);
+    const RegEx chosen = compile_regex(_pattern.c_str());
+    const std::regex reference(_pattern, std::regex::extended);
+
+    // Every engine other than Tokex itself
+    const std::vector<
+        std::pair<const char *,
+                  std::function<bool(const std::string &)>>>
+        engines = {
+            {"frozen",
+             [&](const std::string &_s) {
+                 return frozen.match(_s);
+             }},
+            {regex_engine_name(chosen.engine()),
+             [&](const std::string &_s) {
+                 return chosen.match(_s);
+             }},
+            {"graph",
+             [&](const std::string &_s) {
+                 return graph.match(_s);
+             }},
+        };
+
+    double match_ns = 0.0;
+    size_t bytes = 0;
+    for (const auto &input : _inputs)
+    {
+        start = clk::steady_clock::now();
+        const bool expected = regex_match(tokex, input.c_str());
+        end = clk::steady_clock::now();
+        match_ns +=
+            clk::duration<double, std::nano>(end - start)
+                .count();
+        bytes += input.size() + 1;
+
+        for (const auto &engine : engines)
+        {
+            const bool got = engine.second(input);
+            if (got != expected && out.finding < found_internal)
+            {
+                out.finding = found_internal;
+                out.detail = describe(input, engine.first, got,
+                                      expected);
+            }
+        }
+
+        if (chosen.search(input) != graph.search(input) &&
+            out.finding < found_internal)
+        {
+            out.finding = found_internal;
+            out.detail = "on '" + input + "' " +
+                         regex_engine_name(chosen.engine()) +
+                         " search disagrees with graph";
+        }
+
+        const bool truth = std::regex_match(input, reference);
+        if (truth != expected && out.finding < found_reference)
+        {
+            out.finding = found_reference;
+            out.detail =
+                describe(input, "tokex", expected, truth);
+        }
+    }
+    out.match_ns_per_byte = match_ns / bytes;
+
+    return out;
+}
+
+static std::vector<std::string> generate_inputs(
+    Choices &_c, const std::string &_pattern)
+{
+    std::vector<std::string> out = {""};
+    for (int i = 1; i < inputs_per_case; ++i)
+    {
+        out.push_back(generate_input(_c, _pattern));
+    }
+    return out;
+}
+
+////////////////////////////////////////////////////////////////
+// libFuzzer entry point
+
+#ifdef TOKEX_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *_data,
+                                      size_t _size)
+{
+    Choices c(_data, _size);
+    const std::string pattern = generate_pattern(c, max_depth);
+    const auto inputs = generate_inputs(c, pattern);
+    const CaseResult r = run_case(pattern, inputs);
+
+    if (r.finding != found_nothing)
+    {
+        std::cerr << finding_names[r.finding] << ": /"
+                  << pattern << "/ " << r.detail << '\n';
+        abort();
+    }
+    return 0;
+}
+
+#else
+
+////////////////////////////////////////////////////////////////
+// Seeded driver
+
+/*
+Runs a case in a child process where possible, so that crashes
+and hangs in the compiler are contained and reported.
+*/
+static CaseResult run_case_contained(
+    const std::string &_pattern,
+    const std::vector<std::string> &_inputs)
+{
+#ifdef FUZZ_FORK
+    int fds[2];
+    if (pipe(fds) == 0)
+    {
+        const pid_t child = fork();
+        if (child == 0)
+        {
+            // Assertion and terminate messages are noise here
+            close(fds[0]);
+            freopen("/dev/null", "w", stderr);
+            alarm(case_timeout_s);
+
+            rlimit stack;
+            getrlimit(RLIMIT_STACK, &stack);
+            stack.rlim_cur = std::min<rlim_t>(stack.rlim_cur,
+                                              case_stack_bytes);
+            setrlimit(RLIMIT_STACK, &stack);
+
+            const CaseResult r = run_case(_pattern, _inputs);
+            std::ostringstream msg;
+            msg << r.finding << ' ' << r.compile_us << ' '
+                << r.match_ns_per_byte << '\n'
+                << r.detail;
+
+            const std::string text = msg.str();
+            for (size_t sent = 0; sent < text.size();)
+            {
+                const ssize_t n =
+                    write(fds[1], text.data() + sent,
+                          text.size() - sent);
+                if (n <= 0)
+                {
+                    break;
+                }
+                sent += n;
+            }
+            _exit(0);
+        }
+
+        close(fds[1]);
+        std::string text;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = read(fds[0], buffer, sizeof(buffer))) > 0)
+        {
+            text.append(buffer, n);
+        }
+        close(fds[0]);
+
+        int status = 0;
+        waitpid(child, &status, 0);
+
+        CaseResult out;
+        if (WIFSIGNALED(status))
+        {
+            const int sig = WTERMSIG(status);
+            out.finding =
+                sig == SIGALRM ? found_timeout : found_crash;
+            out.detail = strsignal(sig);
+            return out;
+        }
+
+        std::istringstream lines(text);
+        int finding = found_nothing;
+        lines >> finding >> out.compile_us >>
+            out.match_ns_per_byte;
+        lines.ignore(1);
+        std::getline(lines, out.detail, '\0');
+        out.finding = (Finding)finding;
+        return out;
+    }
+#endif
+
+    return run_case(_pattern, _inputs);
+}
+
+/*
+Shrink a pattern while it still produces the same kind of
+finding, by deleting single bytes and then whole parenthesized
+groups. Every candidate must stay in the generated grammar.
+*/
+static std::string minimize(
+    std::string _pattern,
+    const std::vector<std::string> &_inputs,
+    const Finding &_finding)
+{
+    const auto deadline =
+        clk::steady_clock::now() +
+        clk::duration<double>(minimize_budget_s);
+    const auto still_fails = [&](const std::string &_p) {
+        return in_grammar(_p) &&
+               clk::steady_clock::now() < deadline &&
+               run_case_contained(_p, _inputs).finding ==
+                   _finding;
+    };
+
+    bool shrunk = true;
+    while (shrunk && clk::steady_clock::now() < deadline)
+    {
+        shrunk = false;
+        for (size_t i = 0; i < _pattern.size(); ++i)
+        {
+            // The group starting here, if any, then this byte
+            size_t length = 0;
+            if (_pattern[i] == '(')
+            {
+                int depth = 0;
+                while (i + length < _pattern.size())
+                {
+                    const char c = _pattern[i + length++];
+                    if (c == '\\')
+                    {
+                        ++length;
+                    }
+                    depth += (c == '(') - (c == ')');
+                    if (depth == 0)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            for (const size_t n : {length, (size_t)1})
+            {
+                std::string candidate = _pattern;
+                candidate.erase(i, n);
+                if (n != 0 && still_fails(candidate))
+                {
+                    _pattern = candidate;
+                    shrunk = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return _pattern;
+}
+
+// A timed case, for outlier reporting.
+struct Timing
+{
+    std::string pattern;
+    double compile_us_per_byte, match_ns_per_byte;
+};
+
+// Print the cases whose `_of` is far above the median.
+static size_t report_outliers(std::vector<Timing> _timings,
+                              double Timing::*_of,
+                              const char *_what)
+{
+    if (_timings.empty())
+    {
+        return 0;
+    }
+
+    std::sort(_timings.begin(), _timings.end(),
+              [&](const Timing &_a, const Timing &_b) {
+                  return _a.*_of > _b.*_of;
+              });
+    const double median = _timings[_timings.size() / 2].*_of;
+
+    size_t count = 0;
+    for (const auto &t : _timings)
+    {
+        if (t.*_of <= outlier_factor * median)
+        {
+            break;
+        }
+        if (count < max_reports)
+        {
+            std::cout << "Slow " << _what << " ("
+                      << t.*_of / median << "x median): /"
+                      << t.pattern << "/\n";
+        }
+        ++count;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    const uint64_t cases =
+        argc > 1 ? std::stoull(argv[1]) : 500;
+    const uint64_t seed = argc > 2 ? std::stoull(argv[2]) : 1;
+
+    Choices c(seed);
+    std::array<size_t, found_crash + 1> found = {};
+    std::vector<Timing> timings;
+
+    for (uint64_t i = 0; i < cases; ++i)
+    {
+        const std::string pattern =
+            generate_pattern(c, max_depth);
+        const auto inputs = generate_inputs(c, pattern);
+        const CaseResult r =
+            run_case_contained(pattern, inputs);
+
+        if (r.finding != found_nothing &&
+            found[r.finding]++ < max_reports)
+        {
+            const std::string small =
+                minimize(pattern, inputs, r.finding);
+            std::cout
+                << finding_names[r.finding] << ": /" << small
+                << "/ "
+                << run_case_contained(small, inputs).detail
+                << "\n    (from /" << pattern << "/)\n";
+        }
+
+        if (r.finding < found_error)
+        {
+            timings.push_back({pattern,
+                               r.compile_us / pattern.size(),
+                               r.match_ns_per_byte});
+        }
+    }
+
+    const size_t slow =
+        report_outliers(timings, &Timing::compile_us_per_byte,
+                        "compile") +
+        report_outliers(timings, &Timing::match_ns_per_byte,
+                        "match");
+
+    std::cout << '\n'
+              << cases << " patterns (seed " << seed << "):\n";
+    for (int f = found_crash; f > found_nothing; --f)
+    {
+        std::cout << "  " << found[f] << " "
+                  << finding_names[f] << '\n';
+    }
+    std::cout << "  " << slow << " performance outliers\n";
+
+    for (int f = found_reference; f <= found_crash; ++f)
+    {
+        if (found[f] != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif
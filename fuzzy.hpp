@@ -0,0 +1,413 @@
+/*
+Approximate matching: how few byte edits (insertions, deletions
+and substitutions) turn a text, or some part of it, into a
+string a pattern accepts, up to a fixed number of edits.
+
+Literals of up to 64 bytes are matched with Myers' bit-parallel
+algorithm, as Hyyrö formulates it: one column of the edit
+distance table is kept as two 64-bit masks of its vertical
+differences, and each byte of the text updates them in a dozen
+word operations. Other patterns are frozen into a table (see
+`frozen.hpp`) and simulated as a Levenshtein automaton, which
+keeps the fewest edits that reach each state of the table. This
+costs O(states * k) per byte, so suits the small patterns and
+small `k` this is meant for, such as keywords with typos.
+
+Both run in a single pass over the text. Edits are counted in
+bytes, so UTF-8 mode is not supported.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "frozen.hpp"
+#include "regex.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The best approximate match found by a search: where it ends,
+// and how many edits it takes.
+struct FuzzyMatch
+{
+    size_t end = 0, distance = 0;
+
+    bool operator==(const FuzzyMatch &) const = default;
+};
+
+class FuzzyRegex
+{
+  public:
+    // The most edits which can be allowed.
+    static constexpr size_t max_edits_limit = 254;
+
+    // The most states a non-literal pattern's table may have.
+    static constexpr size_t max_states = 1 << 12;
+
+    // Compile `_pattern`, allowing up to `_max_edits` edits.
+    // Only `RegexOptions::fold_case` is used from `_options`.
+    FuzzyRegex(const std::string &_pattern,
+               const size_t &_max_edits,
+               const RegexOptions &_options = RegexOptions())
+        : max_edits(_max_edits)
+    {
+        if (_options.utf8)
+        {
+            throw std::runtime_error(
+                "Fuzzy matching does not support UTF-8 mode.");
+        }
+        else if (max_edits > max_edits_limit)
+        {
+            throw std::runtime_error(
+                "Too many edits for fuzzy matching.");
+        }
+
+        std::string literal;
+        if (RegEx::parse_literal(_pattern, literal) &&
+            !literal.empty() && literal.size() <= 64)
+        {
+            build_masks(literal, _options.fold_case);
+            return;
+        }
+
+        NfaOptions nfa;
+        nfa.fold_case = _options.fold_case;
+        RegexGraph graph =
+            compile_regex_graph(_pattern.c_str(), nfa);
+        build_table(FrozenRegex(graph, 0));
+    }
+
+    // The fewest edits which make the whole of `_text` match,
+    // or nothing if that is more than the edits allowed.
+    std::optional<size_t> distance(
+        const std::string_view &_text) const
+    {
+        if (length != 0)
+        {
+            return distance_masks(_text);
+        }
+        const auto found = run_table(_text, false);
+        if (!found)
+        {
+            return std::nullopt;
+        }
+        return found->distance;
+    }
+
+    // The part of `_text` which needs the fewest edits to
+    // match, if any needs no more than the edits allowed. Of
+    // those needing equally few, the first to end is found.
+    std::optional<FuzzyMatch> search(
+        const std::string_view &_text) const
+    {
+        if (length != 0)
+        {
+            return search_masks(_text);
+        }
+        return run_table(_text, true);
+    }
+
+    bool is_literal() const noexcept
+    {
+        return length != 0;
+    }
+
+    size_t get_max_edits() const noexcept
+    {
+        return max_edits;
+    }
+
+  protected:
+    // The edit count of a state no run reaches.
+    static constexpr uint8_t unreached = UINT8_MAX;
+
+    ////////////////////////////////////////////////////////////
+    // Literals
+
+    void build_masks(const std::string &_literal,
+                     const bool &_fold_case)
+    {
+        length = _literal.size();
+        peq.fill(0);
+        for (size_t i = 0; i < length; ++i)
+        {
+            const uint8_t c = _literal[i];
+            peq[c] |= uint64_t(1) << i;
+
+            const uint8_t lower = c | 0x20;
+            if (_fold_case && lower >= 'a' && lower <= 'z')
+            {
+                peq[c ^ 0x20] |= uint64_t(1) << i;
+            }
+        }
+    }
+
+    // One column of Myers' algorithm. `_top` is 1 when the
+    // top row of the table grows by one per byte, as when the
+    // whole text must match, and 0 when any start is free.
+    struct Column
+    {
+        uint64_t pv = ~uint64_t(0), mv = 0;
+        size_t score;
+
+        void step(const uint64_t &_eq, const uint64_t &_high,
+                  const uint64_t &_top) noexcept
+        {
+            const uint64_t xv = _eq | mv;
+            const uint64_t xh = (((_eq & pv) + pv) ^ pv) | _eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & _high)
+            {
+                ++score;
+            }
+            else if (mh & _high)
+            {
+                --score;
+            }
+            ph = (ph << 1) | _top;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+        }
+    };
+
+    std::optional<size_t> distance_masks(
+        const std::string_view &_text) const noexcept
+    {
+        const uint64_t high = uint64_t(1) << (length - 1);
+        Column column;
+        column.score = length;
+
+        for (size_t i = 0; i < _text.size(); ++i)
+        {
+            column.step(peq[(uint8_t)_text[i]], high, 1);
+
+            // Each byte left moves the score by at most one
+            const size_t left = _text.size() - i - 1;
+            if (column.score > max_edits + left)
+            {
+                return std::nullopt;
+            }
+        }
+
+        if (column.score > max_edits)
+        {
+            return std::nullopt;
+        }
+        return column.score;
+    }
+
+    std::optional<FuzzyMatch> search_masks(
+        const std::string_view &_text) const noexcept
+    {
+        const uint64_t high = uint64_t(1) << (length - 1);
+        Column column;
+        column.score = length;
+        FuzzyMatch best = {0, length};
+
+        for (size_t i = 0;
+             i < _text.size() && best.distance != 0; ++i)
+        {
+            column.step(peq[(uint8_t)_text[i]], high, 0);
+            if (column.score < best.distance)
+            {
+                best = {i + 1, column.score};
+            }
+        }
+
+        if (best.distance > max_edits)
+        {
+            return std::nullopt;
+        }
+        return best;
+    }
+
+    ////////////////////////////////////////////////////////////
+    // Other patterns
+
+    void build_table(const FrozenRegex &_from)
+    {
+        const size_t n = _from.state_count();
+        if (n > max_states)
+        {
+            throw std::runtime_error(
+                "Pattern is too large for fuzzy matching.");
+        }
+
+        number_classes = _from.class_count();
+        for (int b = 0; b < 256; ++b)
+        {
+            classes[b] = _from.byte_class(b);
+        }
+        std::vector<unsigned char> member(number_classes);
+        for (int b = 255; b >= 0; --b)
+        {
+            member[classes[b]] = b;
+        }
+
+        start = _from.start_state();
+        accepting.resize(n);
+        table.resize(n * number_classes);
+        successor_first.assign(1, 0);
+        for (uint32_t s = 0; s < n; ++s)
+        {
+            accepting[s] = _from.is_accepting(s);
+
+            const size_t first = successors.size();
+            for (size_t c = 0; c < number_classes; ++c)
+            {
+                const uint32_t to =
+                    _from.next_state(s, member[c]);
+                table[s * number_classes + c] = to;
+                if (to != FrozenRegex::dead_state &&
+                    std::find(successors.begin() + first,
+                              successors.end(),
+                              to) == successors.end())
+                {
+                    successors.push_back(to);
+                }
+            }
+            successor_first.push_back(successors.size());
+        }
+    }
+
+    // Lower the edits of every state reachable by inserting
+    // bytes into the text, fewest edits first.
+    void insert(std::vector<uint8_t> &_edits) const noexcept
+    {
+        for (size_t d = 0; d < max_edits; ++d)
+        {
+            for (uint32_t s = 1; s < _edits.size(); ++s)
+            {
+                if (_edits[s] != d)
+                {
+                    continue;
+                }
+                for (size_t i = successor_first[s];
+                     i < successor_first[s + 1]; ++i)
+                {
+                    uint8_t &to = _edits[successors[i]];
+                    to = std::min<uint8_t>(to, d + 1);
+                }
+            }
+        }
+    }
+
+    // The fewest edits of any accepting state.
+    uint8_t accepted(
+        const std::vector<uint8_t> &_edits) const noexcept
+    {
+        uint8_t out = unreached;
+        for (uint32_t s = 1; s < _edits.size(); ++s)
+        {
+            if (accepting[s])
+            {
+                out = std::min(out, _edits[s]);
+            }
+        }
+        return out;
+    }
+
+    // Run the Levenshtein automaton over `_text`. When
+    // searching, a run begins before every byte, and the best
+    // end is kept; otherwise the whole text is read. This
+    // allocates two rows of one byte per state.
+    std::optional<FuzzyMatch> run_table(
+        const std::string_view &_text,
+        const bool &_search) const
+    {
+        std::vector<uint8_t> edits(accepting.size(), unreached);
+        std::vector<uint8_t> next(accepting.size());
+        edits[start] = 0;
+        insert(edits);
+        FuzzyMatch best = {0, accepted(edits)};
+
+        for (size_t i = 0; i < _text.size(); ++i)
+        {
+            if (_search && best.distance == 0)
+            {
+                break;
+            }
+
+            const uint8_t c = classes[(uint8_t)_text[i]];
+            std::fill(next.begin(), next.end(), unreached);
+            bool live = false;
+            for (uint32_t s = 1; s < edits.size(); ++s)
+            {
+                const uint8_t d = edits[s];
+                if (d > max_edits)
+                {
+                    continue;
+                }
+                live = true;
+
+                // The byte is read
+                const uint32_t to =
+                    table[s * number_classes + c];
+                next[to] = std::min(next[to], d);
+                if (d == max_edits)
+                {
+                    continue;
+                }
+
+                // Or deleted, or replaced by any other
+                next[s] = std::min<uint8_t>(next[s], d + 1);
+                for (size_t j = successor_first[s];
+                     j < successor_first[s + 1]; ++j)
+                {
+                    uint8_t &other = next[successors[j]];
+                    other = std::min<uint8_t>(other, d + 1);
+                }
+            }
+            if (!live && !_search)
+            {
+                return std::nullopt;
+            }
+
+            next[FrozenRegex::dead_state] = unreached;
+            if (_search)
+            {
+                next[start] = 0;
+            }
+            insert(next);
+            edits.swap(next);
+
+            const uint8_t found = accepted(edits);
+            if (_search ? found < best.distance : true)
+            {
+                best = {i + 1, found};
+            }
+        }
+
+        if (best.distance > max_edits)
+        {
+            return std::nullopt;
+        }
+        return best;
+    }
+
+    size_t max_edits = 0;
+
+    // For literals: the literal's length, and for each byte a
+    // mask of the positions at which it appears.
+    size_t length = 0;
+    std::array<uint64_t, 256> peq;
+
+    // For other patterns: a dense table over byte classes, and
+    // the distinct states each state leads to on any byte,
+    // from successors[successor_first[s]] up to the next.
+    std::array<uint8_t, 256> classes;
+    size_t number_classes = 1;
+    uint32_t start = FrozenRegex::dead_state;
+    std::vector<uint32_t> table, successors;
+    std::vector<size_t> successor_first;
+    std::vector<uint8_t> accepting;
+};
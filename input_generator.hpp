@@ -0,0 +1,276 @@
+/*
+Generates inputs for a pattern by walking its frozen automaton:
+random strings the pattern accepts, of a chosen length, and near
+misses which it rejects. This replaces hand-written input lists
+when benchmarking or testing arbitrary patterns.
+
+For each length k and state s, the generator keeps the number of
+accepted strings of length k which can be read from s. Walking
+forwards and only taking bytes whose target can still finish in
+the remaining length means generation never reaches a dead end.
+The same counts let bytes be chosen in proportion to the number
+of accepted strings through them, so that every accepted string
+of a given length is equally likely.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "frozen.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class InputGenerator
+{
+  public:
+    // How each byte of an accepted string is chosen.
+    enum Weighting
+    {
+        // Uniformly among the bytes which can still lead to an
+        // accepted string of the requested length.
+        uniform_bytes,
+
+        // In proportion to the number of accepted strings of
+        // the requested length through each byte, so every such
+        // string is equally likely.
+        path_count,
+    };
+
+    // Printable ASCII, the default alphabet.
+    static std::string printable_bytes()
+    {
+        std::string out;
+        for (char c = ' '; c <= '~'; ++c)
+        {
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    // Generated strings only contain bytes from `_alphabet`,
+    // which must not be empty. The pattern must outlive the
+    // generator.
+    InputGenerator(const FrozenRegex &_pattern,
+                   const uint64_t &_seed = 0,
+                   const Weighting &_weighting = path_count,
+                   const std::string &_alphabet =
+                       printable_bytes())
+        : pattern(_pattern), weighting(_weighting), rng(_seed)
+    {
+        if (_alphabet.empty())
+        {
+            throw std::runtime_error(
+                "Cannot generate from an empty alphabet.");
+        }
+
+        // Group the alphabet by byte class
+        std::vector<int> group_of_class(256, -1);
+        for (const char &c : _alphabet)
+        {
+            const uint8_t cls = pattern.byte_class(c);
+            if (group_of_class[cls] == -1)
+            {
+                group_of_class[cls] = groups.size();
+                groups.emplace_back();
+            }
+            std::string &g = groups[group_of_class[cls]];
+            if (g.find(c) == std::string::npos)
+            {
+                g.push_back(c);
+                alphabet.push_back(c);
+            }
+        }
+
+        // Where each group leads from each state
+        const size_t n = pattern.state_count();
+        targets.resize(n * groups.size());
+        for (size_t s = 0; s < n; ++s)
+        {
+            for (size_t g = 0; g < groups.size(); ++g)
+            {
+                targets[s * groups.size() + g] =
+                    pattern.next_state(s, groups[g][0]);
+            }
+        }
+
+        completions.emplace_back(n);
+        for (size_t s = 0; s < n; ++s)
+        {
+            completions[0][s] = pattern.is_accepting(s);
+        }
+    }
+
+    // A random accepted string of exactly `_length` bytes, or
+    // nothing if there is none.
+    std::optional<std::string> accepted(const size_t &_length)
+    {
+        extend_to(_length);
+        uint32_t state = pattern.start_state();
+        if (completions[_length][state] == 0.0)
+        {
+            return std::nullopt;
+        }
+
+        std::string out;
+        std::vector<double> weights(groups.size());
+        for (size_t left = _length; left > 0; --left)
+        {
+            const auto &row = completions[left - 1];
+            for (size_t g = 0; g < groups.size(); ++g)
+            {
+                const double c =
+                    row[targets[state * groups.size() + g]];
+                if (weighting == uniform_bytes)
+                {
+                    weights[g] = groups[g].size() * (c != 0.0);
+                }
+                else
+                {
+                    weights[g] = groups[g].size() * c;
+                }
+            }
+
+            std::discrete_distribution<size_t> pick(
+                weights.begin(), weights.end());
+            const std::string &group = groups[pick(rng)];
+            out.push_back(group[rng() % group.size()]);
+            state = pattern.next_state(state, out.back());
+        }
+
+        return out;
+    }
+
+    // A random accepted string whose length is drawn uniformly
+    // from those in [_min_length, _max_length] which have any,
+    // or nothing if none do.
+    std::optional<std::string> accepted(
+        const size_t &_min_length, const size_t &_max_length)
+    {
+        extend_to(_max_length);
+        std::vector<size_t> lengths;
+        for (size_t l = _min_length; l <= _max_length; ++l)
+        {
+            if (completions[l][pattern.start_state()] != 0.0)
+            {
+                lengths.push_back(l);
+            }
+        }
+
+        if (lengths.empty())
+        {
+            return std::nullopt;
+        }
+        return accepted(lengths[rng() % lengths.size()]);
+    }
+
+    // A rejected string one edit (a substitution, insertion,
+    // deletion or truncation) away from an accepted string with
+    // a length in [_min_length, _max_length]. Returns nothing
+    // if no such string was found, as for `.*`.
+    std::optional<std::string> near_miss(
+        const size_t &_min_length, const size_t &_max_length)
+    {
+        for (int attempt = 0; attempt < max_attempts; ++attempt)
+        {
+            std::optional<std::string> base =
+                accepted(_min_length, _max_length);
+            if (!base.has_value())
+            {
+                return std::nullopt;
+            }
+
+            std::string &s = *base;
+            const size_t at = rng() % (s.size() + 1);
+            const char c = alphabet[rng() % alphabet.size()];
+            switch (rng() % 4)
+            {
+            case 0:
+                if (at == s.size())
+                {
+                    continue;
+                }
+                s[at] = c;
+                break;
+            case 1:
+                s.insert(s.begin() + at, c);
+                break;
+            case 2:
+                if (at == s.size())
+                {
+                    continue;
+                }
+                s.erase(at, 1);
+                break;
+            default:
+                s.resize(at);
+                break;
+            }
+
+            if (!pattern.match(s))
+            {
+                return s;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+  protected:
+    // Edits tried by `near_miss` before giving up.
+    static const int max_attempts = 64;
+
+    // Extend the completion counts to cover `_length`.
+    void extend_to(const size_t &_length)
+    {
+        const size_t n = pattern.state_count();
+        while (completions.size() <= _length)
+        {
+            const auto &prev = completions.back();
+            std::vector<double> row(n, 0.0);
+            double largest = 0.0;
+
+            for (size_t s = 0; s < n; ++s)
+            {
+                for (size_t g = 0; g < groups.size(); ++g)
+                {
+                    const uint32_t t =
+                        targets[s * groups.size() + g];
+                    row[s] += groups[g].size() * prev[t];
+                }
+                largest = std::max(largest, row[s]);
+            }
+
+            // Counts grow exponentially with length; only their
+            // ratios within a row are used, so scale each row
+            // to keep it in range.
+            for (double &c : row)
+            {
+                c /= largest == 0.0 ? 1.0 : largest;
+            }
+
+            completions.push_back(std::move(row));
+        }
+    }
+
+    const FrozenRegex &pattern;
+    const Weighting weighting;
+    std::mt19937_64 rng;
+
+    // The alphabet, and its bytes grouped by byte class.
+    std::string alphabet;
+    std::vector<std::string> groups;
+
+    // targets[state * groups.size() + group] is the next state.
+    std::vector<uint32_t> targets;
+
+    // completions[k][s] is proportional to the number of
+    // accepted strings of length k read from state s.
+    std::vector<std::vector<double>> completions;
+};
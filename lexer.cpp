@@ -4,6 +4,7 @@ jdehmel@outlook.com
 */
 
 #include "lexer.hpp"
+#include "trace.hpp"
 #include <fstream>
 
 bool Lexer::is_initialized = false;
@@ -601,10 +602,12 @@ std::list<Token> Lexer::lex_l(const std::string &from) noexcept
 
     std::list<Token> out;
 
+    TOKEX_TRACE2(lex__start, this, text.size());
     while (!done())
     {
         out.push_back(single());
     }
+    TOKEX_TRACE2(lex__end, this, out.size());
 
     erase_comments(out);
     erase_whitespace(out);
@@ -629,10 +632,12 @@ std::list<Token> Lexer::lex_l(
 
     std::list<Token> out;
 
+    TOKEX_TRACE2(lex__start, this, text.size());
     while (!done())
     {
         out.push_back(single());
     }
+    TOKEX_TRACE2(lex__end, this, out.size());
 
     erase_comments(out);
     erase_whitespace(out);
@@ -656,10 +661,12 @@ std::vector<Token> Lexer::lex_v(const std::string &What,
 
     std::list<Token> out;
 
+    TOKEX_TRACE2(lex__start, this, text.size());
     while (!done())
     {
         out.push_back(single());
     }
+    TOKEX_TRACE2(lex__end, this, out.size());
 
     erase_comments(out);
     erase_whitespace(out);
@@ -0,0 +1,231 @@
+/*
+An optional, bounded cache of match results for one compiled
+pattern, for traffic in which the same inputs recur (user
+agents, hostnames, IDs). A repeated input then costs one hash
+and one comparison of its bytes, rather than a run of the
+automaton.
+
+Entries are spread over shards by the high bits of the input's
+hash, each behind its own lock and on its own cache lines, so
+threads rarely contend. Within a shard, entries are
+direct-mapped by the low bits of the hash: a miss overwrites
+whatever shared its slot. Every entry keeps its input's bytes,
+which are compared on a hit, so a hash collision can never give
+a wrong result. Inputs longer than `max_input_length` are
+matched directly, uncached. All memory is allocated up front, so
+neither hits nor misses allocate.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "regex.hpp"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Totals across every shard of a MatchCache.
+struct MatchCacheStats
+{
+    // Inputs answered from the cache, matched and then stored,
+    // and matched directly for being too long.
+    uint64_t hits = 0, misses = 0, bypassed = 0;
+
+    double hit_rate() const noexcept
+    {
+        const uint64_t total = hits + misses + bypassed;
+        return total == 0 ? 0.0 : hits / (double)total;
+    }
+};
+
+class MatchCache
+{
+  public:
+    // The default for `max_input_length`.
+    static constexpr size_t default_input_length = 128;
+
+    // Cache results of `_pattern` for up to `_entries` inputs
+    // (rounded up to a power of two) of at most
+    // `_max_input_length` bytes each. There is one shard per
+    // hardware thread unless `_shards` is given.
+    MatchCache(const std::shared_ptr<const RegEx> &_pattern,
+               const size_t &_entries,
+               const size_t &_max_input_length =
+                   default_input_length,
+               const size_t &_shards = 0)
+        : pattern(_pattern), max_input_length(_max_input_length)
+    {
+        if (pattern == nullptr || _entries == 0)
+        {
+            throw std::runtime_error(
+                "A match cache needs a pattern and entries.");
+        }
+        else if (_max_input_length > UINT32_MAX)
+        {
+            // Slots store lengths in 32 bits
+            throw std::runtime_error(
+                "Cached inputs must fit a 32-bit length.");
+        }
+
+        const size_t cores =
+            std::thread::hardware_concurrency();
+        const size_t wanted =
+            _shards != 0 ? _shards : std::max<size_t>(cores, 1);
+        const size_t entries = std::bit_ceil(_entries);
+        shard_count = std::min(std::bit_ceil(wanted), entries);
+        slots_per_shard = entries / shard_count;
+
+        shards = std::make_unique<Shard[]>(shard_count);
+        for (size_t i = 0; i < shard_count; ++i)
+        {
+            shards[i].slots.resize(slots_per_shard);
+            shards[i].keys.resize(slots_per_shard *
+                                  max_input_length);
+        }
+    }
+
+    // Whether the pattern matches all of `_text`, from the
+    // cache if it holds the answer.
+    bool match(const std::string_view &_text)
+    {
+        if (_text.size() > max_input_length)
+        {
+            // Counted in a shard picked by length, so as not to
+            // hash a long input
+            const bool out = pattern->match(_text);
+            Shard &shard =
+                shards[_text.size() & (shard_count - 1)];
+            std::lock_guard<std::mutex> lock(shard.lock);
+            ++shard.bypassed;
+            return out;
+        }
+
+        const uint64_t hash =
+            std::hash<std::string_view>()(_text);
+        // The high half of the hash picks the shard and the
+        // low half the slot, whatever the width of size_t
+        const size_t high =
+            hash >> (std::numeric_limits<size_t>::digits / 2);
+        Shard &shard = shards[high & (shard_count - 1)];
+        const size_t index = hash & (slots_per_shard - 1);
+        char *const key = &shard.keys[index * max_input_length];
+
+        {
+            std::lock_guard<std::mutex> lock(shard.lock);
+            const Slot &slot = shard.slots[index];
+            // A default string_view has no data to compare
+            if (slot.used && slot.hash == hash &&
+                slot.length == _text.size() &&
+                (_text.empty() ||
+                 memcmp(key, _text.data(), _text.size()) == 0))
+            {
+                ++shard.hits;
+                return slot.result;
+            }
+        }
+
+        // Match outside the lock, then store
+        const bool out = pattern->match(_text);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        shard.slots[index] = {hash, (uint32_t)_text.size(), out,
+                              true};
+        if (!_text.empty())
+        {
+            memcpy(key, _text.data(), _text.size());
+        }
+        ++shard.misses;
+        return out;
+    }
+
+    bool match(const char *const _text)
+    {
+        return match(std::string_view(_text));
+    }
+
+    // Hit, miss and bypass counts so far.
+    MatchCacheStats stats() const
+    {
+        MatchCacheStats out;
+        for (size_t i = 0; i < shard_count; ++i)
+        {
+            std::lock_guard<std::mutex> lock(shards[i].lock);
+            out.hits += shards[i].hits;
+            out.misses += shards[i].misses;
+            out.bypassed += shards[i].bypassed;
+        }
+        return out;
+    }
+
+    // Forget every cached result, keeping the counts.
+    void clear()
+    {
+        for (size_t i = 0; i < shard_count; ++i)
+        {
+            std::lock_guard<std::mutex> lock(shards[i].lock);
+            for (Slot &slot : shards[i].slots)
+            {
+                slot.used = false;
+            }
+        }
+    }
+
+    size_t shard_number() const noexcept
+    {
+        return shard_count;
+    }
+
+    // The most results held at once.
+    size_t capacity() const noexcept
+    {
+        return shard_count * slots_per_shard;
+    }
+
+    const RegEx &get_pattern() const noexcept
+    {
+        return *pattern;
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage out;
+        out.states = capacity() * sizeof(Slot);
+        out.auxiliary =
+            capacity() * max_input_length +
+            shard_count * sizeof(Shard);
+        return out;
+    }
+
+  protected:
+    struct Slot
+    {
+        uint64_t hash = 0;
+        uint32_t length = 0;
+        bool result = false, used = false;
+    };
+
+    // Aligned so that no two shards share a cache line.
+    struct alignas(64) Shard
+    {
+        mutable std::mutex lock;
+        std::vector<Slot> slots;
+
+        // Slot i's input begins at keys[i * max_input_length].
+        std::vector<char> keys;
+        uint64_t hits = 0, misses = 0, bypassed = 0;
+    };
+
+    std::shared_ptr<const RegEx> pattern;
+    size_t max_input_length;
+    size_t shard_count = 1, slots_per_shard = 1;
+    std::unique_ptr<Shard[]> shards;
+};
@@ -0,0 +1,188 @@
+/*
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char *perf_event_name(const PerfEvent &_event)
+{
+    static const char *const names[number_perf_events] = {
+        "cycles",     "instructions",  "l1d_misses",
+        "llc_misses", "branch_misses",
+    };
+    return names[_event];
+}
+
+#ifdef __linux__
+
+// The perf_event_attr type and config for each counter.
+static void describe_event(const PerfEvent &_event,
+                           perf_event_attr &_attr)
+{
+    switch (_event)
+    {
+    case perf_cycles:
+        _attr.type = PERF_TYPE_HARDWARE;
+        _attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case perf_instructions:
+        _attr.type = PERF_TYPE_HARDWARE;
+        _attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case perf_l1d_misses:
+        _attr.type = PERF_TYPE_HW_CACHE;
+        _attr.config = PERF_COUNT_HW_CACHE_L1D |
+                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case perf_llc_misses:
+        _attr.type = PERF_TYPE_HARDWARE;
+        _attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case perf_branch_misses:
+        _attr.type = PERF_TYPE_HARDWARE;
+        _attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+}
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < number_perf_events; ++i)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        describe_event((PerfEvent)i, attr);
+
+        fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                         0);
+        if (fds[i] < 0 && why_unavailable.empty())
+        {
+            why_unavailable = std::string("perf_event_open: ") +
+                              strerror(errno);
+        }
+    }
+
+    if (available())
+    {
+        why_unavailable.clear();
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int i = 0; i < number_perf_events; ++i)
+    {
+        if (fds[i] >= 0)
+        {
+            close(fds[i]);
+        }
+    }
+}
+
+void PerfCounters::start() noexcept
+{
+    for (int i = 0; i < number_perf_events; ++i)
+    {
+        if (fds[i] >= 0)
+        {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+PerfReading PerfCounters::stop() noexcept
+{
+    PerfReading out;
+
+    for (int i = 0; i < number_perf_events; ++i)
+    {
+        if (fds[i] >= 0)
+        {
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for (int i = 0; i < number_perf_events; ++i)
+    {
+        // Value, time enabled, time running
+        uint64_t data[3];
+        if (fds[i] < 0 ||
+            read(fds[i], data, sizeof(data)) != sizeof(data) ||
+            data[2] == 0)
+        {
+            continue;
+        }
+
+        out.valid[i] = true;
+        out.counts[i] = (double)data[0] * data[1] / data[2];
+    }
+
+    return out;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+{
+    for (int i = 0; i < number_perf_events; ++i)
+    {
+        fds[i] = -1;
+    }
+    why_unavailable = "perf_event_open requires Linux";
+}
+
+PerfCounters::~PerfCounters()
+{
+}
+
+void PerfCounters::start() noexcept
+{
+}
+
+PerfReading PerfCounters::stop() noexcept
+{
+    return PerfReading();
+}
+
+#endif
+
+bool PerfCounters::available() const noexcept
+{
+    for (int i = 0; i < number_perf_events; ++i)
+    {
+        if (fds[i] >= 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PerfCounters::available(
+    const PerfEvent &_event) const noexcept
+{
+    return fds[_event] >= 0;
+}
+
+const std::string &PerfCounters::error() const noexcept
+{
+    return why_unavailable;
+}
@@ -0,0 +1,73 @@
+/*
+Optional hardware performance counters, read through Linux's
+`perf_event_open`. Each counter is opened on its own, so any
+subset may be available; counters which cannot be opened (for
+instance inside a container, on a VM without a virtual PMU, or
+on a platform other than Linux) are simply reported as missing.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+The counters which may be read.
+*/
+enum PerfEvent
+{
+    perf_cycles = 0,
+    perf_instructions,
+    perf_l1d_misses,
+    perf_llc_misses,
+    perf_branch_misses, // Must be last
+};
+
+const static int number_perf_events = perf_branch_misses + 1;
+
+// The name of each counter, as used in reports.
+const char *perf_event_name(const PerfEvent &_event);
+
+/*
+The counts accumulated between a `start` and a `stop`. Counts
+are scaled up if the kernel had to multiplex the counter.
+*/
+struct PerfReading
+{
+    bool valid[number_perf_events] = {};
+    double counts[number_perf_events] = {};
+};
+
+/*
+A set of per-thread counters measuring user-space work only.
+*/
+class PerfCounters
+{
+  public:
+    // Attempt to open every counter.
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // True if at least one counter could be opened.
+    bool available() const noexcept;
+    bool available(const PerfEvent &_event) const noexcept;
+
+    // Why counters are unavailable, if they are.
+    const std::string &error() const noexcept;
+
+    // Zero and enable all open counters.
+    void start() noexcept;
+
+    // Disable all open counters and read them.
+    PerfReading stop() noexcept;
+
+  protected:
+    int fds[number_perf_events];
+    std::string why_unavailable;
+};
@@ -1,167 +1,1133 @@
 /*
-Adapts the TokEx interface for standard RegEx.
+Compiles standard RegEx patterns, choosing an executor for each
+by analysing it at compile time:
+
+- A pattern with no unescaped metacharacters is a literal. It is
+  matched by comparing bytes, and no automaton is built at all.
+- Otherwise the pattern's node graph is compiled (see
+  `regex_graph.hpp`). If a dense transition table for it would
+  fit within `RegexOptions::dense_table_limit` bytes, the graph
+  is frozen into one (see `frozen.hpp`). Tables of 16 states
+  or fewer are run with byte shuffles (see `shuffle.hpp`).
+- Larger automata are compressed by row displacement (see
+  `comb.hpp`) if that fits within the same limit.
+- Failing that, they are matched by walking the node graph
+  itself, which costs a map lookup per byte but no table.
+
+Every executor accepts the same strings as the node graph. An
+escaped byte is only ever itself, so `\.` matches only a dot. In
+UTF-8 mode (`RegexOptions::utf8`), `.` is compiled into a small
+automaton over the bytes of each character (see
+`expression.hpp`), so executors still read bytes. With
+`RegexOptions::fold_case`, each ASCII letter is given
+transitions on both cases, so a case-insensitive match runs the
+same table as any other. Such literals are compiled as automata
+too, rather than compared byte for byte.
+`explain` reports what was chosen and why.
+
+Before running an automaton, inputs are checked against bounds
+found at compile time (see `regex_bounds.hpp`): those of the
+wrong length, or missing a byte every match contains, are
+rejected at once.
+
+`search` finds the leftmost, then longest, match within a text,
+as POSIX does. Literals are found with `memmem`, which glibc
+implements with the Two-Way algorithm and vector instructions.
+For table engines, the first search builds a forward and a
+reverse automaton (see `span_finder.hpp`), which find the end
+and then the start of the match in two linear passes. Patterns
+on the node graph, or whose search automata would be over
+`RegexOptions::search_table_limit`, are instead tried from each
+start in turn, skipping those the bounds rule out.
+
 Jordan Dehmel, 2024
 jdehmel@outlook.com
 */
 
+#pragma once
+
+#include "comb.hpp"
+#include "frozen.hpp"
+#include "regex_bounds.hpp"
+#include "regex_graph.hpp"
+#include "shuffle.hpp"
+#include "span_finder.hpp"
+#include "trace.hpp"
+#include <atomic>
 #include <cstring>
-#include <vector>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
 
-#pragma once
+// The executors a pattern may be dispatched to.
+enum RegexEngine
+{
+    engine_literal, // Byte comparison against a literal
+    engine_dense,   // A dense table over byte classes
+    engine_shuffle, // Byte shuffles, for 16 states or fewer
+    engine_comb,    // A row-displaced table, for large automata
+    engine_graph,   // Walking the compiled node graph
+};
 
-#ifdef SAVEFIG
+inline const char *regex_engine_name(const RegexEngine &_engine)
+{
+    switch (_engine)
+    {
+    case engine_literal:
+        return "literal";
+    case engine_dense:
+        return "dense";
+    case engine_shuffle:
+        return "shuffle";
+    case engine_comb:
+        return "comb";
+    default:
+        return "graph";
+    }
+}
+
+// A match found by searching: `length` bytes from `begin`.
+struct RegexSpan
+{
+    size_t begin = 0, length = 0;
 
-#ifndef FORCE_TOKEX_SAVEFIG
-#undef SAVEFIG
-#endif
+    bool operator==(const RegexSpan &) const = default;
+};
 
-#include "tokex.hpp"
-#include <cstdint>
+// Settings for compiling a pattern.
+struct RegexOptions
+{
+    // Automata whose dense table would be larger than this
+    // many bytes are matched on their node graph instead.
+    size_t dense_table_limit = 1 << 20;
 
-#define SAVEFIG
+    // Dense tables also get a stride-2 table, which reads two
+    // bytes per lookup, if it fits in this many bytes.
+    size_t stride_table_limit =
+        FrozenRegex::default_stride_limit;
 
-#else
+    // Dense tables of at most this many states are run with
+    // byte shuffles instead (see shuffle.hpp), unless they have
+    // states which skip ahead. 0 disables this.
+    size_t shuffle_state_limit = ShuffleRegex::max_states;
 
-#include "tokex.hpp"
+    // Automata over `dense_table_limit` are compressed by row
+    // displacement instead if their dense table would be at
+    // most this many bytes. The rows are read from the graph
+    // one at a time, so this bounds the time spent building,
+    // not the memory.
+    size_t comb_build_limit = 1 << 26;
 
-#endif
+    // The forward and reverse automata built for searching
+    // may take at most this many bytes together. Over it,
+    // searches try each start in turn.
+    size_t search_table_limit = 1 << 20;
 
-class TokexChar
+    // Read `.` as one UTF-8 encoded character, and repeat a
+    // character of several bytes whole (see NfaOptions). The
+    // automaton still reads bytes, so ASCII costs the same.
+    bool utf8 = false;
+
+    // Match ASCII letters in either case. Both cases of a
+    // letter lead to the same state, so they usually share a
+    // byte class and matching costs the same as without this.
+    bool fold_case = false;
+};
+
+class RegEx
 {
   public:
-    TokexChar(const char &_data) : data(_data)
+    // A pattern which matches nothing.
+    RegEx()
     {
     }
-    TokexChar(const TokexChar &_other) : data(_other.data)
+
+    explicit RegEx(
+        const std::string &_pattern,
+        const RegexOptions &_options = RegexOptions())
+        : pattern(_pattern), options(_options)
     {
+        if (parse_literal(_pattern, literal) &&
+            !(options.fold_case && has_letters(literal)))
+        {
+            if (options.utf8)
+            {
+                check_utf8(literal);
+            }
+            chosen = engine_literal;
+            states = literal.size() + 2;
+            classes = std::set<char>(literal.begin(),
+                                     literal.end())
+                          .size() +
+                      1;
+            bounds = RegexBounds(literal);
+            return;
+        }
+
+        literal.clear();
+        graph_ptr = std::make_unique<RegexGraph>(
+            compile_regex_graph(_pattern.c_str(),
+                                nfa_options()));
+        estimate_dense_size(*graph_ptr);
+        bounds = RegexBounds(*graph_ptr);
+
+        if (dense_table_bytes() <= options.dense_table_limit)
+        {
+            dense = FrozenRegex(*graph_ptr,
+                                options.stride_table_limit);
+            states = dense.state_count();
+            classes = dense.class_count();
+            chosen = engine_dense;
+            graph_ptr.reset();
+            spans = std::make_unique<LazySpans>();
+
+            if (states <= options.shuffle_state_limit &&
+                ShuffleRegex::fits(dense) &&
+                dense.accelerated_count() == 0)
+            {
+                shuffle = ShuffleRegex(dense);
+                chosen = engine_shuffle;
+            }
+            return;
+        }
+
+        chosen = engine_graph;
+        if (dense_table_bytes() <= options.comb_build_limit)
+        {
+            CombRegex packed(*graph_ptr);
+            if (packed.memory_usage().total() <=
+                options.dense_table_limit)
+            {
+                comb = std::move(packed);
+                states = comb.state_count();
+                chosen = engine_comb;
+                graph_ptr.reset();
+                spans = std::make_unique<LazySpans>();
+            }
+        }
+    }
+
+    // Returns true if and only if all of the given bytes match
+    // the pattern. `_scanned` is set to the number of bytes
+    // examined, which is less than `_length` if the match was
+    // rejected early. This does not allocate. It fires the
+    // match__start and match__end probes (see `trace.hpp`),
+    // whichever engine runs.
+    bool match(const char *const _text, const size_t &_length,
+               size_t &_scanned) const noexcept
+    {
+        TOKEX_TRACE2(match__start, this, _length);
+        const bool out = match_engine(_text, _length, _scanned);
+        TOKEX_TRACE2(match__end, this, out);
+        return out;
+    }
+
+    bool match(const char *const _text,
+               const size_t &_length) const noexcept
+    {
+        size_t scanned;
+        return match(_text, _length, scanned);
+    }
+
+    bool match(const std::string_view &_text) const noexcept
+    {
+        return match(_text.data(), _text.size());
     }
 
-    inline bool operator<(const TokexChar &_other) const
+    bool match(const char *const _text) const noexcept
     {
-        return data < _other.data;
+        return match(_text, strlen(_text));
     }
-    inline bool operator>(const TokexChar &_other) const
+
+    // Match each of `_count` texts, writing the results to
+    // `_out`. The shuffle engine runs these two at a time. This
+    // does not allocate.
+    void match_many(const std::string_view *const _texts,
+                    const size_t &_count,
+                    bool *const _out) const noexcept
     {
-        return data > _other.data;
+        if (chosen == engine_shuffle)
+        {
+            shuffle.match_many(_texts, _count, _out);
+            return;
+        }
+
+        for (size_t i = 0; i < _count; ++i)
+        {
+            _out[i] = match(_texts[i]);
+        }
     }
-    inline bool operator==(const TokexChar &_other) const
+
+    // The leftmost, then longest, match of the pattern within
+    // the given bytes, or nothing. The first search of a table
+    // engine builds its search automata, which is safe from
+    // many threads at once; later searches are linear and do
+    // not allocate. Otherwise, each start which the bounds
+    // allow is tried in turn, so this is quadratic in the worst
+    // case.
+    std::optional<RegexSpan> search(
+        const char *const _text,
+        const size_t &_length) const noexcept
     {
-        return data < _other.data;
+        if (chosen == engine_literal)
+        {
+            return search_literal(_text, _length);
+        }
+
+        size_t cursor = RegexBounds::npos;
+        if (const SpanFinder *finder = span_finder())
+        {
+            const size_t from =
+                bounds.next_start(_text, _length, 0, cursor);
+            size_t begin, end;
+            if (from == RegexBounds::npos ||
+                !finder->find(_text, _length, from, begin, end))
+            {
+                return std::nullopt;
+            }
+            return RegexSpan{begin, end - begin};
+        }
+
+        for (size_t begin = 0;; ++begin)
+        {
+            begin = bounds.next_start(_text, _length, begin,
+                                      cursor);
+            if (begin == RegexBounds::npos)
+            {
+                break;
+            }
+
+            const size_t length =
+                longest_prefix(_text + begin, _length - begin);
+            if (length != FrozenRegex::npos)
+            {
+                return RegexSpan{begin, length};
+            }
+        }
+        return std::nullopt;
     }
 
-    char data;
+    std::optional<RegexSpan> search(
+        const std::string_view &_text) const noexcept
+    {
+        return search(_text.data(), _text.size());
+    }
 
-    static inline bool is_subexpr_open(const TokexChar &_c)
+    std::optional<RegexSpan> search(
+        const char *const _text) const noexcept
     {
-        return _c.data == '(';
+        return search(_text, strlen(_text));
     }
 
-    static inline bool is_subexpr_close(const TokexChar &_c)
+    RegexEngine engine() const noexcept
     {
-        return _c.data == ')';
+        return chosen;
     }
 
-    static inline bool is_disjunction(const TokexChar &_c)
+    const std::string &get_pattern() const noexcept
     {
-        return _c.data == '|';
+        return pattern;
     }
 
-    static inline bool is_wildcard(const TokexChar &_c)
+    const RegexOptions &get_options() const noexcept
     {
-        return _c.data == '.';
+        return options;
     }
 
-    static inline bool is_optional(const TokexChar &_c)
+    // Lengths and bytes every accepted string has. See
+    // RegexBounds.
+    const RegexBounds &get_bounds() const noexcept
     {
-        return _c.data == '?';
+        return bounds;
     }
 
-    static inline bool is_star(const TokexChar &_c)
+    // The node graph of this pattern. Unless the graph is the
+    // executor, it is compiled again on first use, so this is
+    // not safe to call while other threads use this object.
+    RegexGraph &graph()
     {
-        return _c.data == '*';
+        if (graph_ptr == nullptr)
+        {
+            graph_ptr = std::make_unique<RegexGraph>(
+                compile_regex_graph(pattern.c_str(),
+                                    nfa_options()));
+        }
+        return *graph_ptr;
     }
 
-    static inline bool is_plus(const TokexChar &_c)
+    // The number of states in the automaton, including the
+    // dead state. This is exact for dense tables, and for
+    // literals counts the automaton which was not built.
+    size_t state_count() const noexcept
     {
-        return _c.data == '+';
+        return states;
     }
 
-    static inline bool is_escape(const TokexChar &_c)
+    // Estimated heap bytes held by the executor.
+    MemoryUsage memory_usage() const
     {
-        return _c.data == '\\';
+        MemoryUsage out;
+        switch (chosen)
+        {
+        case engine_literal:
+            out.transitions = literal.capacity();
+            break;
+        case engine_dense:
+            out = dense.memory_usage();
+            break;
+        case engine_shuffle:
+            // The dense table is kept for searching
+            out = shuffle.memory_usage();
+            out += dense.memory_usage();
+            break;
+        case engine_comb:
+            out = comb.memory_usage();
+            break;
+        default:
+            out = graph_ptr->memory_usage();
+            break;
+        }
+        if (spans != nullptr && spans->built)
+        {
+            out += spans->finder.memory_usage();
+        }
+        out.auxiliary += pattern.capacity();
+        return out;
     }
 
-    static inline bool is_mem_clear(const TokexChar &_c)
+    // A human-readable report of the executor chosen for this
+    // pattern, its prefilter, its size and its memory use.
+    std::string explain() const
     {
-        return false;
+        std::ostringstream out;
+        out << "pattern:   " << pattern << '\n'
+            << "engine:    " << regex_engine_name(chosen)
+            << '\n'
+            << "prefilter: "
+            << (chosen == engine_literal ? "memmem"
+                                         : "length and bytes")
+            << '\n'
+            << "text:      "
+            << (options.utf8 ? "UTF-8" : "bytes")
+            << (options.fold_case ? ", folding case" : "")
+            << '\n'
+            << "lengths:   ";
+        if (bounds.min_length() == RegexBounds::npos)
+        {
+            out << "none";
+        }
+        else if (bounds.max_length() == RegexBounds::npos)
+        {
+            out << bounds.min_length() << " or more";
+        }
+        else
+        {
+            out << bounds.min_length() << " to "
+                << bounds.max_length();
+        }
+        out << "\nrequired:  \"" << bounds.required_bytes()
+            << "\"\n"
+            << "states:    " << states
+            << (chosen == engine_literal ? " (estimated)" : "")
+            << '\n'
+            << "classes:   " << classes << '\n';
+        if (chosen == engine_shuffle)
+        {
+            out << "vectors:   " << shuffle.instructions()
+                << '\n';
+        }
+        else if (chosen == engine_dense)
+        {
+            out << "skipping:  " << dense.accelerated_count()
+                << " accelerated states\n"
+                << "stride:    " << dense.stride() << " ("
+                << dense.stride_table_bytes()
+                << " byte stride-2 table, limit "
+                << options.stride_table_limit << ")\n"
+                << "ids:       " << 8 * dense.id_width()
+                << "-bit\n";
+        }
+        if (spans != nullptr)
+        {
+            out << "search:    ";
+            if (!spans->built)
+            {
+                out << "two passes, built on first use\n";
+            }
+            else if (spans->finder.available())
+            {
+                out << "two passes, "
+                    << spans->finder.forward_count()
+                    << " forward and "
+                    << spans->finder.reverse_count()
+                    << " reverse states\n";
+            }
+            else
+            {
+                out << "each start (automata over "
+                    << options.search_table_limit
+                    << " bytes)\n";
+            }
+        }
+        out << "memory:    " << memory_usage().total()
+            << " bytes\n";
+        if (chosen == engine_comb)
+        {
+            out << "A dense table would need "
+                << dense_table_bytes() << " bytes, over the "
+                << options.dense_table_limit
+                << " byte limit; rows overlap in "
+                << comb.entry_count() << " entries.\n";
+        }
+        else if (chosen == engine_graph)
+        {
+            out << "A dense table would need "
+                << dense_table_bytes() << " bytes, over the "
+                << options.dense_table_limit
+                << " byte limit.\n";
+        }
+        return out.str();
     }
 
-    static inline bool is_mem_pipe(const TokexChar &_c)
+    // If `_pattern` has no unescaped metacharacters, write the
+    // bytes it matches to `_literal` and return true.
+    static bool parse_literal(const std::string &_pattern,
+                              std::string &_literal)
     {
-        return false;
+        _literal.clear();
+        for (size_t i = 0; i < _pattern.size(); ++i)
+        {
+            const TokexChar c(_pattern[i]);
+            if (TokexChar::is_escape(c))
+            {
+                if (++i == _pattern.size())
+                {
+                    return false;
+                }
+            }
+            else if (TokexChar::is_subexpr_open(c) ||
+                     TokexChar::is_subexpr_close(c) ||
+                     TokexChar::is_disjunction(c) ||
+                     TokexChar::is_wildcard(c) ||
+                     TokexChar::is_optional(c) ||
+                     TokexChar::is_star(c) ||
+                     TokexChar::is_plus(c))
+            {
+                return false;
+            }
+            _literal.push_back(_pattern[i]);
+        }
+        return true;
     }
 
-    static inline bool is_epsilon(const TokexChar &_c)
+  protected:
+    // Throws std::runtime_error unless `_bytes` is UTF-8.
+    static void check_utf8(const std::string &_bytes)
     {
-        return _c.data == '\0';
+        const uint8_t *const bytes =
+            (const uint8_t *)_bytes.data();
+        for (size_t i = 0; i < _bytes.size();)
+        {
+            const size_t length =
+                utf8_character(bytes + i, _bytes.size() - i);
+            if (length == 0)
+            {
+                throw std::runtime_error(
+                    "Invalid UTF-8 in pattern.");
+            }
+            i += length;
+        }
     }
 
-    static char wildcard()
+    static bool has_letters(const std::string &_bytes)
     {
-        return '.';
+        return std::any_of(
+            _bytes.begin(), _bytes.end(), [](const char &_c) {
+                const char lower = _c | 0x20;
+                return lower >= 'a' && lower <= 'z';
+            });
     }
-    static char epsilon()
+
+    NfaOptions nfa_options() const noexcept
     {
-        return '\0';
+        NfaOptions out;
+        out.utf8 = options.utf8;
+        out.fold_case = options.fold_case;
+        return out;
     }
+
+    // Count the states and an upper bound on the byte classes
+    // of a dense table for `_graph`, without building it. Bytes
+    // which no transition names all share one class.
+    void estimate_dense_size(RegexGraph &_graph)
+    {
+        std::set<char> named;
+        const auto nodes = _graph.get_all_nodes();
+        for (const Node<TokexChar> *node : nodes)
+        {
+            for (const auto &p : node->next)
+            {
+                named.insert(p.first.data);
+            }
+        }
+        states = nodes.size() + 1;
+        classes = std::min<size_t>(named.size() + 1, 256);
+    }
+
+    // State ids are stored in as few bytes as they fit in.
+    size_t dense_table_bytes() const noexcept
+    {
+        const size_t entries = states * classes;
+        return entries * FrozenRegex::id_bytes(entries) + 256;
+    }
+
+    // The node reached by reading `_c` at `_node`, exactly as
+    // in `Tokex::run`, or nullptr.
+    static const Node<TokexChar> *graph_step(
+        const Node<TokexChar> *const _node,
+        const char &_c) noexcept
+    {
+        auto it = _node->next.find(TokexChar::byte(_c));
+        if (it == _node->next.end())
+        {
+            it = _node->next.find(TokexChar::wildcard());
+        }
+        return it == _node->next.end() ? nullptr : it->second;
+    }
+
+    // Run the chosen engine for `match`.
+    bool match_engine(const char *const _text,
+                      const size_t &_length,
+                      size_t &_scanned) const noexcept
+    {
+        if (chosen == engine_literal)
+        {
+            if (_length != literal.size())
+            {
+                _scanned = 0;
+                return false;
+            }
+            _scanned = _length;
+            return memcmp(_text, literal.data(), _length) == 0;
+        }
+        else if (!bounds.may_match(_text, _length))
+        {
+            _scanned = 0;
+            return false;
+        }
+        else if (chosen == engine_dense)
+        {
+            return dense.match(_text, _length, _scanned);
+        }
+        else if (chosen == engine_shuffle)
+        {
+            return shuffle.match(_text, _length, _scanned);
+        }
+        else if (chosen == engine_comb)
+        {
+            return comb.match(_text, _length, _scanned);
+        }
+        return match_graph(_text, _length, _scanned);
+    }
+
+    bool match_graph(const char *const _text,
+                     const size_t &_length,
+                     size_t &_scanned) const noexcept
+    {
+        const Node<TokexChar> *cur = graph_ptr->get_beginning();
+
+        for (size_t i = 0; i < _length && cur != nullptr; ++i)
+        {
+            cur = graph_step(cur, _text[i]);
+            if (cur == nullptr)
+            {
+                _scanned = i + 1;
+                return false;
+            }
+        }
+
+        _scanned = _length;
+        return cur != nullptr && state_to_bool(cur->type);
+    }
+
+    // The length of the longest accepted prefix of the given
+    // bytes, or `FrozenRegex::npos`. Not used for literals.
+    size_t longest_prefix(const char *const _text,
+                          const size_t &_length) const noexcept
+    {
+        if (chosen == engine_dense || chosen == engine_shuffle)
+        {
+            return dense.longest_prefix(_text, _length);
+        }
+        else if (chosen == engine_comb)
+        {
+            return comb.longest_prefix(_text, _length);
+        }
+
+        const Node<TokexChar> *cur = graph_ptr->get_beginning();
+        size_t out = FrozenRegex::npos;
+        for (size_t i = 0; cur != nullptr; ++i)
+        {
+            if (state_to_bool(cur->type))
+            {
+                out = i;
+            }
+            if (i == _length)
+            {
+                break;
+            }
+            cur = graph_step(cur, _text[i]);
+        }
+        return out;
+    }
+
+    // The search automata, building them on first use, or
+    // nullptr if searches try each start instead. Searches are
+    // noexcept, so if building fails, as when memory runs out,
+    // the automata are left unavailable rather than throwing.
+    const SpanFinder *span_finder() const noexcept
+    {
+        if (spans == nullptr)
+        {
+            return nullptr;
+        }
+
+        try
+        {
+            std::call_once(spans->once, [&]() {
+                const size_t limit = options.search_table_limit;
+                try
+                {
+                    spans->finder =
+                        chosen == engine_comb
+                            ? SpanFinder(comb, limit)
+                            : SpanFinder(dense, limit);
+                }
+                catch (const std::exception &)
+                {
+                    spans->finder = SpanFinder();
+                }
+                spans->built = true;
+            });
+        }
+        catch (const std::system_error &)
+        {
+            // The once flag is left unset, so a later search
+            // tries again
+            return nullptr;
+        }
+        return spans->finder.available() ? &spans->finder
+                                         : nullptr;
+    }
+
+    // Find a literal with `memchr` or `memmem`.
+    std::optional<RegexSpan> search_literal(
+        const char *const _text,
+        const size_t &_length) const noexcept
+    {
+        if (literal.empty())
+        {
+            return RegexSpan{0, 0};
+        }
+        else if (_length < literal.size())
+        {
+            return std::nullopt;
+        }
+
+        const void *const found =
+            literal.size() == 1
+                ? memchr(_text, literal[0], _length)
+                : memmem(_text, _length, literal.data(),
+                         literal.size());
+        if (found == nullptr)
+        {
+            return std::nullopt;
+        }
+        return RegexSpan{
+            (size_t)((const char *)found - _text),
+            literal.size()};
+    }
+
+    std::string pattern;
+    RegexOptions options;
+    RegexEngine chosen = engine_dense;
+    size_t states = 1, classes = 1;
+
+    // Facts about every accepted string, checked first.
+    RegexBounds bounds;
+
+    // The executors; only the chosen one is populated, except
+    // that the shuffle engine searches with its dense table.
+    std::string literal;
+    FrozenRegex dense;
+    ShuffleRegex shuffle;
+    CombRegex comb;
+    std::unique_ptr<RegexGraph> graph_ptr;
+
+    // The search automata of a table engine, built once.
+    struct LazySpans
+    {
+        std::once_flag once;
+        std::atomic<bool> built = false;
+        SpanFinder finder;
+    };
+    std::unique_ptr<LazySpans> spans;
 };
 
-inline std::ostream &operator<<(std::ostream &_strm,
-                                const TokexChar &_c)
+// Compile a pattern, choosing its executor. See RegEx.
+inline RegEx compile_regex(
+    const char *const _pattern,
+    const RegexOptions &_options = RegexOptions())
 {
-    return _strm << _c.data;
+    return RegEx(_pattern, _options);
 }
 
-typedef Tokex<TokexChar> RegEx;
+inline bool regex_match(const RegEx &_pattern,
+                        const char *_text)
+{
+    return _pattern.match(_text);
+}
+
+inline std::optional<RegexSpan> regex_search(
+    const RegEx &_pattern, const char *_text)
+{
+    return _pattern.search(_text);
+}
+
+////////////////////////////////////////////////////////////////
+
+/*
+Walks the matches of a pattern in a text, each found by
+`RegEx::search` from the end of the last. As in most engines,
+after an empty match the search resumes one character on, so
+that every position is tried. The pattern and text are not
+copied, and must outlive the iterator; iterating allocates
+nothing beyond the pattern's first search.
+*/
+class RegexMatchIterator
+{
+  public:
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::forward_iterator_tag;
+
+    // An iterator past the last match.
+    RegexMatchIterator()
+    {
+    }
+
+    RegexMatchIterator(const RegEx &_pattern,
+                       const std::string_view &_text)
+        : pattern(&_pattern), text(_text)
+    {
+        find(0);
+    }
+
+    std::string_view operator*() const noexcept
+    {
+        return text.substr(match.begin, match.length);
+    }
+
+    // Where the current match lies in the text.
+    const RegexSpan &span() const noexcept
+    {
+        return match;
+    }
 
-static RegEx compile_regex(const char *const _pattern)
+    RegexMatchIterator &operator++() noexcept
+    {
+        find(next);
+        return *this;
+    }
+
+    RegexMatchIterator operator++(int) noexcept
+    {
+        RegexMatchIterator out = *this;
+        ++*this;
+        return out;
+    }
+
+    bool operator==(const RegexMatchIterator &_other) const
+        noexcept
+    {
+        return pattern == _other.pattern &&
+               (pattern == nullptr ||
+                match.begin == _other.match.begin);
+    }
+
+    bool operator==(std::default_sentinel_t) const noexcept
+    {
+        return pattern == nullptr;
+    }
+
+  protected:
+    // Find the first match at or after `_from`, or become an
+    // iterator past the last.
+    void find(const size_t &_from) noexcept
+    {
+        const std::optional<RegexSpan> found =
+            _from > text.size()
+                ? std::nullopt
+                : pattern->search(text.data() + _from,
+                                  text.size() - _from);
+        if (!found)
+        {
+            pattern = nullptr;
+            match = RegexSpan();
+            return;
+        }
+
+        match = {_from + found->begin, found->length};
+        next = match.begin + match.length;
+        if (match.length == 0)
+        {
+            // Step over one byte, or one character in UTF-8
+            size_t step = 1;
+            if (pattern->get_options().utf8 &&
+                next < text.size())
+            {
+                step = std::max<size_t>(
+                    1, utf8_character(
+                           (const uint8_t *)text.data() + next,
+                           text.size() - next));
+            }
+            next += step;
+        }
+    }
+
+    const RegEx *pattern = nullptr;
+    std::string_view text;
+    RegexSpan match;
+    size_t next = 0;
+};
+
+/*
+Walks the parts of a text between the matches of a pattern
+(see RegexMatchIterator), including any before the first match
+and after the last, so there is always one more part than
+there are matches. Parts may be empty.
+*/
+class RegexSplitIterator
 {
-    std::vector<TokexChar> v_pattern;
-    v_pattern.reserve(strlen(_pattern));
-    for (const char *ptr = _pattern; *ptr; ++ptr)
+  public:
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using iterator_concept = std::forward_iterator_tag;
+
+    // An iterator past the last part.
+    RegexSplitIterator()
     {
-        v_pattern.push_back(TokexChar(*ptr));
     }
 
-    RegEx out(v_pattern);
+    RegexSplitIterator(const RegEx &_pattern,
+                       const std::string_view &_text)
+        : matches(_pattern, _text), text(_text), done(false)
+    {
+    }
 
-#ifdef SAVEFIG
+    std::string_view operator*() const noexcept
+    {
+        const size_t end = matches == std::default_sentinel
+                               ? text.size()
+                               : matches.span().begin;
+        return text.substr(first, end - first);
+    }
 
-    static uint64_t id = 0;
-    out.graphviz(std::to_string(id) + ".dot", _pattern);
-    system(("dot -Tpng " + std::to_string(id) + ".dot -o " +
-            std::to_string(id) + ".png")
-               .c_str());
+    RegexSplitIterator &operator++() noexcept
+    {
+        if (matches == std::default_sentinel)
+        {
+            done = true;
+        }
+        else
+        {
+            first = matches.span().begin +
+                    matches.span().length;
+            ++matches;
+        }
+        return *this;
+    }
 
-#ifdef SAVEFIGPATH
-    system(("mv " + std::to_string(id) + ".* " SAVEFIGPATH)
-               .c_str());
-#endif
+    RegexSplitIterator operator++(int) noexcept
+    {
+        RegexSplitIterator out = *this;
+        ++*this;
+        return out;
+    }
 
-    ++id;
+    bool operator==(const RegexSplitIterator &_other) const
+        noexcept
+    {
+        return done == _other.done &&
+               (done || (first == _other.first &&
+                         matches == _other.matches));
+    }
 
-#endif
+    bool operator==(std::default_sentinel_t) const noexcept
+    {
+        return done;
+    }
 
-    return out;
+  protected:
+    RegexMatchIterator matches;
+    std::string_view text;
+    size_t first = 0;
+    bool done = true;
+};
+
+// A lazy range over an iterator above, which composes with
+// `std::views`. The pattern and text must outlive it.
+template <typename Iterator>
+class RegexRange
+    : public std::ranges::view_interface<RegexRange<Iterator>>
+{
+  public:
+    RegexRange()
+    {
+    }
+
+    RegexRange(const RegEx &_pattern,
+               const std::string_view &_text)
+        : pattern(&_pattern), text(_text)
+    {
+    }
+
+    Iterator begin() const
+    {
+        return pattern ? Iterator(*pattern, text) : Iterator();
+    }
+
+    std::default_sentinel_t end() const noexcept
+    {
+        return std::default_sentinel;
+    }
+
+  protected:
+    const RegEx *pattern = nullptr;
+    std::string_view text;
+};
+
+typedef RegexRange<RegexMatchIterator> RegexMatches;
+typedef RegexRange<RegexSplitIterator> RegexSplit;
+
+// Every match of `_pattern` in `_text`, lazily.
+inline RegexMatches regex_matches(const RegEx &_pattern,
+                                  const std::string_view &_text)
+{
+    return RegexMatches(_pattern, _text);
 }
 
-static bool regex_match(RegEx &_pattern, const char *_text)
+// The parts of `_text` between matches of `_pattern`, lazily.
+inline RegexSplit regex_split(const RegEx &_pattern,
+                              const std::string_view &_text)
 {
-    std::list<TokexChar> l_text;
-    for (const char *ptr = _text; *ptr; ++ptr)
+    return RegexSplit(_pattern, _text);
+}
+
+////////////////////////////////////////////////////////////////
+
+/*
+Replacement text is copied as written, except that `$&` and `$0`
+stand for the match and `$$` for a dollar sign. Patterns have no
+capture groups, so no other reference is valid; this throws
+std::runtime_error if one is used, saying so for `$1` to `$9`.
+*/
+inline void check_replacement(const std::string_view &_with)
+{
+    for (size_t i = 0; i < _with.size(); ++i)
+    {
+        if (_with[i] != '$')
+        {
+            continue;
+        }
+        else if (++i < _with.size() && _with[i] >= '1' &&
+                 _with[i] <= '9')
+        {
+            throw std::runtime_error(
+                "Capture references such as $1 are not "
+                "supported, as patterns have no capture "
+                "groups.");
+        }
+        else if (i == _with.size() ||
+                 (_with[i] != '&' && _with[i] != '0' &&
+                  _with[i] != '$'))
+        {
+            throw std::runtime_error(
+                "Replacements may only refer to $&, $0 or $$.");
+        }
+    }
+}
+
+// Write a checked replacement for `_match` to `_sink`, in runs
+// between references.
+template <typename Sink>
+inline void write_replacement(const std::string_view &_with,
+                              const std::string_view &_match,
+                              Sink &_sink)
+{
+    size_t run = 0;
+    for (size_t i = 0; i < _with.size(); ++i)
     {
-        l_text.push_back(TokexChar(*ptr));
+        if (_with[i] != '$')
+        {
+            continue;
+        }
+        _sink(_with.substr(run, i - run));
+        ++i;
+        _sink(_with[i] == '$' ? _with.substr(i, 1) : _match);
+        run = i + 1;
     }
+    _sink(_with.substr(run));
+}
+
+/*
+Replace every match of `_pattern` in `_text` (see
+RegexMatchIterator) with `_with` (see `check_replacement`). The
+pattern comes first, as everywhere in this file, so the order is
+(pattern, text, replacement) rather than std::regex_replace's
+(text, pattern, replacement). The result is written to `_sink`
+as a series of `std::string_view`s. The text between matches is
+written whole, so this reads the text once (and each match
+twice) and allocates nothing beyond the first search.
+*/
+template <typename Sink>
+inline void regex_replace(const RegEx &_pattern,
+                          const std::string_view &_text,
+                          const std::string_view &_with,
+                          Sink &&_sink)
+{
+    check_replacement(_with);
 
-    return _pattern.match(l_text);
+    size_t from = 0;
+    for (auto it = RegexMatchIterator(_pattern, _text);
+         it != std::default_sentinel; ++it)
+    {
+        const RegexSpan &span = it.span();
+        _sink(_text.substr(from, span.begin - from));
+        write_replacement(_with, *it, _sink);
+        from = span.begin + span.length;
+    }
+    _sink(_text.substr(from));
+}
+
+// As above, but returning the result.
+inline std::string regex_replace(const RegEx &_pattern,
+                                 const std::string_view &_text,
+                                 const std::string_view &_with)
+{
+    std::string out;
+    out.reserve(_text.size());
+    regex_replace(_pattern, _text, _with,
+                  [&](const std::string_view &_part) {
+                      out.append(_part);
+                  });
+    return out;
 }
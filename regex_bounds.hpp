@@ -0,0 +1,413 @@
+/*
+Facts about every string a pattern accepts, found from its
+automaton at compile time: the shortest and longest accepted
+lengths, and the bytes which every accepted string contains.
+
+An input outside the length bounds is rejected without reading
+it, and one missing a required byte is rejected after a
+`memchr`, which is much faster than running the automaton.
+Searching uses the same facts to skip starts which cannot begin
+a match.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "regex_graph.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class RegexBounds
+{
+  public:
+    // A length which is unbounded, or which no string has.
+    static constexpr size_t npos = std::string_view::npos;
+
+    // Bounds for a pattern which accepts any string.
+    RegexBounds()
+    {
+    }
+
+    // Bounds for a pattern which accepts only `_literal`.
+    explicit RegexBounds(const std::string &_literal)
+        : min(_literal.size()), max(_literal.size())
+    {
+        for (const char &c : _literal)
+        {
+            if (required.find(c) == std::string::npos)
+            {
+                required.push_back(c);
+            }
+        }
+        sort_by_rarity();
+    }
+
+    // Analyse a compiled pattern. The pattern is not modified.
+    explicit RegexBounds(RegexGraph &_graph)
+    {
+        // Number the nodes and list their edges
+        const std::list<Node<TokexChar> *> nodes =
+            _graph.get_all_nodes();
+        std::map<const Node<TokexChar> *, size_t> ids;
+        for (const Node<TokexChar> *node : nodes)
+        {
+            const size_t id = ids.size();
+            ids[node] = id;
+        }
+
+        const size_t n = nodes.size();
+        std::vector<std::vector<Edge>> edges(n);
+        std::vector<bool> accepting(n, false);
+        for (const Node<TokexChar> *node : nodes)
+        {
+            const size_t from = ids.at(node);
+            accepting[from] = state_to_bool(node->type);
+            for (const auto &p : node->next)
+            {
+                if (p.second != nullptr &&
+                    !TokexChar::is_epsilon(p.first))
+                {
+                    edges[from].push_back(
+                        {p.first.data,
+                         TokexChar::is_wildcard(p.first),
+                         ids.at(p.second)});
+                }
+            }
+        }
+
+        const auto start = ids.find(_graph.get_beginning());
+        if (start == ids.end())
+        {
+            min = npos;
+            return;
+        }
+
+        // Drop edges into nodes which cannot reach acceptance
+        const std::vector<bool> live = co_reachable(edges,
+                                                    accepting);
+        for (auto &out : edges)
+        {
+            std::erase_if(out, [&](const Edge &_e) {
+                return !live[_e.to];
+            });
+        }
+
+        min = shortest(edges, accepting, start->second);
+        if (min == npos)
+        {
+            return;
+        }
+        max = longest(edges, start->second);
+
+        // A byte is required if acceptance is unreachable
+        // without an edge naming it
+        std::string named;
+        for (const auto &out : edges)
+        {
+            for (const Edge &e : out)
+            {
+                if (!e.wildcard &&
+                    named.find(e.label) == std::string::npos)
+                {
+                    named.push_back(e.label);
+                }
+            }
+        }
+        for (const char &c : named)
+        {
+            if (!reachable_without(edges, accepting,
+                                   start->second, c))
+            {
+                required.push_back(c);
+            }
+        }
+        sort_by_rarity();
+    }
+
+    // The length of the shortest accepted string, or `npos` if
+    // the pattern accepts nothing.
+    size_t min_length() const noexcept
+    {
+        return min;
+    }
+
+    // The length of the longest accepted string, or `npos` if
+    // there is no limit.
+    size_t max_length() const noexcept
+    {
+        return max;
+    }
+
+    // The bytes every accepted string contains, rarest first.
+    const std::string &required_bytes() const noexcept
+    {
+        return required;
+    }
+
+    // False if the given bytes are certainly rejected. This
+    // checks the length, then looks for the rarest required
+    // bytes, and does not allocate.
+    bool may_match(const char *const _text,
+                   const size_t &_length) const noexcept
+    {
+        if (_length < min || _length > max)
+        {
+            return false;
+        }
+
+        const size_t checks =
+            std::min(required.size(), checked_required);
+        for (size_t i = 0; i < checks; ++i)
+        {
+            if (memchr(_text, required[i], _length) == nullptr)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The first start at or after `_begin` where a match could
+    // begin, or `npos` if there is none. `_cursor` caches where
+    // the rarest required byte was last found between calls,
+    // and should be `npos` before the first.
+    size_t next_start(const char *const _text,
+                      const size_t &_length, size_t _begin,
+                      size_t &_cursor) const noexcept
+    {
+        if (min == npos || _begin > _length ||
+            _length - _begin < min)
+        {
+            return npos;
+        }
+        else if (required.empty())
+        {
+            return _begin;
+        }
+
+        // A match from `_begin` contains the next occurrence of
+        // the rarest required byte, so must reach it
+        if (_cursor == npos || _cursor < _begin)
+        {
+            const void *const found =
+                memchr(_text + _begin, required[0],
+                       _length - _begin);
+            if (found == nullptr)
+            {
+                return npos;
+            }
+            _cursor = (const char *)found - _text;
+        }
+
+        if (max != npos && _cursor - _begin >= max)
+        {
+            _begin = _cursor + 1 - max;
+        }
+        return _length - _begin < min ? npos : _begin;
+    }
+
+  protected:
+    // Required bytes looked for by `may_match`.
+    static constexpr size_t checked_required = 2;
+
+    struct Edge
+    {
+        char label;
+        bool wildcard;
+        size_t to;
+    };
+
+    typedef std::vector<std::vector<Edge>> Edges;
+
+    // Which nodes can reach an accepting node.
+    static std::vector<bool> co_reachable(
+        const Edges &_edges,
+        const std::vector<bool> &_accepting)
+    {
+        std::vector<std::vector<size_t>> from(_edges.size());
+        std::queue<size_t> to_visit;
+        std::vector<bool> out = _accepting;
+        for (size_t s = 0; s < _edges.size(); ++s)
+        {
+            for (const Edge &e : _edges[s])
+            {
+                from[e.to].push_back(s);
+            }
+            if (out[s])
+            {
+                to_visit.push(s);
+            }
+        }
+
+        while (!to_visit.empty())
+        {
+            const size_t cur = to_visit.front();
+            to_visit.pop();
+            for (const size_t &s : from[cur])
+            {
+                if (!out[s])
+                {
+                    out[s] = true;
+                    to_visit.push(s);
+                }
+            }
+        }
+        return out;
+    }
+
+    // The fewest edges from `_start` to acceptance, or npos.
+    static size_t shortest(const Edges &_edges,
+                           const std::vector<bool> &_accepting,
+                           const size_t &_start)
+    {
+        std::vector<size_t> dist(_edges.size(), npos);
+        std::queue<size_t> to_visit;
+        dist[_start] = 0;
+        to_visit.push(_start);
+
+        while (!to_visit.empty())
+        {
+            const size_t cur = to_visit.front();
+            to_visit.pop();
+            if (_accepting[cur])
+            {
+                return dist[cur];
+            }
+
+            for (const Edge &e : _edges[cur])
+            {
+                if (dist[e.to] == npos)
+                {
+                    dist[e.to] = dist[cur] + 1;
+                    to_visit.push(e.to);
+                }
+            }
+        }
+        return npos;
+    }
+
+    // The most edges from `_start` to acceptance, or npos if a
+    // cycle makes this unbounded. Every edge leads to a node
+    // which can reach acceptance.
+    static size_t longest(const Edges &_edges,
+                          const size_t &_start)
+    {
+        // Depth-first, without recursion: `order` is the
+        // postorder, and a back edge means a cycle
+        enum Mark
+        {
+            unvisited,
+            open,
+            closed
+        };
+        std::vector<Mark> mark(_edges.size(), unvisited);
+        std::vector<size_t> order;
+        std::vector<std::pair<size_t, size_t>> stack = {
+            {_start, 0}};
+        mark[_start] = open;
+
+        while (!stack.empty())
+        {
+            auto &[node, next] = stack.back();
+            if (next == _edges[node].size())
+            {
+                mark[node] = closed;
+                order.push_back(node);
+                stack.pop_back();
+                continue;
+            }
+
+            const size_t to = _edges[node][next++].to;
+            if (mark[to] == open)
+            {
+                return npos;
+            }
+            else if (mark[to] == unvisited)
+            {
+                mark[to] = open;
+                stack.push_back({to, 0});
+            }
+        }
+
+        // Successors come first in postorder
+        std::vector<size_t> most(_edges.size(), 0);
+        for (const size_t &node : order)
+        {
+            for (const Edge &e : _edges[node])
+            {
+                most[node] =
+                    std::max(most[node], most[e.to] + 1);
+            }
+        }
+        return most[_start];
+    }
+
+    // Whether acceptance is reachable without reading `_c`.
+    static bool reachable_without(
+        const Edges &_edges,
+        const std::vector<bool> &_accepting,
+        const size_t &_start, const char &_c)
+    {
+        std::vector<bool> seen(_edges.size(), false);
+        std::queue<size_t> to_visit;
+        seen[_start] = true;
+        to_visit.push(_start);
+
+        while (!to_visit.empty())
+        {
+            const size_t cur = to_visit.front();
+            to_visit.pop();
+            if (_accepting[cur])
+            {
+                return true;
+            }
+
+            for (const Edge &e : _edges[cur])
+            {
+                if ((e.wildcard || e.label != _c) &&
+                    !seen[e.to])
+                {
+                    seen[e.to] = true;
+                    to_visit.push(e.to);
+                }
+            }
+        }
+        return false;
+    }
+
+    // A rough rank of how often a byte appears in text: lower
+    // case letters and spaces most, then digits and capitals,
+    // then punctuation, then everything else.
+    static int commonness(const char &_c)
+    {
+        if ((_c >= 'a' && _c <= 'z') || _c == ' ')
+        {
+            return 3;
+        }
+        else if ((_c >= '0' && _c <= '9') ||
+                 (_c >= 'A' && _c <= 'Z'))
+        {
+            return 2;
+        }
+        return (_c > ' ' && _c <= '~') ? 1 : 0;
+    }
+
+    void sort_by_rarity()
+    {
+        std::stable_sort(required.begin(), required.end(),
+                         [](const char &_a, const char &_b) {
+                             return commonness(_a) <
+                                    commonness(_b);
+                         });
+    }
+
+    size_t min = 0, max = npos;
+    std::string required;
+};
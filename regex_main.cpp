@@ -7,39 +7,42 @@ jdehmel@outlook.com
 // #define SAVEFIGPATH "regex_dots/"
 // #define SAVEFIG
 
+#include "comb.hpp"
+#include "corpus.hpp"
+#include "frozen.hpp"
+#include "fuzzy.hpp"
+#include "input_generator.hpp"
+#include "match_cache.hpp"
 #include "regex.hpp"
 #include "regex_manager.hpp"
 #include <chrono>
-#include <initializer_list>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <random>
+#include <ranges>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 namespace clk = std::chrono;
 
-////////////////////////////////////////////////////////////////
-// Regex Macros
-
 static RegexManager re_manager;
 
-#define H "(a|b|c|d|e|f|A|B|C|D|E|F|0|1|2|3|4|5|6|7|8|9)"
-#define O "(0|1|2|3|4|5|6|7)"
-
-#define HEX_RE "0(x|X)(" H "+')*" H "+"
-#define OCTAL_RE "(0|0(" O "+')*" O "+)"
-#define BINARY_RE "0(b|B)((0|1)+')*(0|1)+"
-#define DECIMAL_RE "-?(1|2|3|4|5|6|7|8|9)(\\d+')*\\d+"
-
-#define INT_RE "(#{hex}|#{dec}|#{oct}|#{bin})"
-
 ////////////////////////////////////////////////////////////////
 // Helper function(s)
 
 /*
-Asserts that all test cases pass.
+Asserts that all test cases pass, and that the node graph, its
+frozen forms at either stride, its row-displaced form and the
+dense and graph engines all agree on every case, each compiled
+separately. Also asserts that searching with the pattern's
+search automata finds the same spans as the dense engine and
+as trying each start on the graph engine.
 */
-void test_regex(
-    const char *const _pattern,
-    const std::initializer_list<const char *> &_should_pass,
-    const std::initializer_list<const char *> &_should_fail)
+void test_regex(const char *const _pattern,
+                const std::vector<const char *> &_should_pass,
+                const std::vector<const char *> &_should_fail)
 {
     // Timing objects
     clk::high_resolution_clock::time_point start, end;
@@ -55,6 +58,43 @@ void test_regex(
         clk::duration_cast<clk::microseconds>(end - start)
             .count();
 
+    // The other engines, each built from a compile of its own,
+    // so that they only agree if compiling is deterministic
+    const std::string expanded =
+        re_manager.perform_substitutions(_pattern);
+    RegexOptions graph_only, no_shuffle;
+    graph_only.dense_table_limit = 0;
+    no_shuffle.shuffle_state_limit = 0;
+    const char *const source = expanded.c_str();
+    RegEx graph = compile_regex(source, graph_only);
+    const RegEx dense = compile_regex(source, no_shuffle);
+    RegexGraph for_frozen = compile_regex_graph(source);
+    RegexGraph for_strided = compile_regex_graph(source);
+    RegexGraph for_comb = compile_regex_graph(source);
+    const FrozenRegex frozen(for_frozen, 0);
+    const FrozenRegex strided(for_strided, SIZE_MAX);
+    const CombRegex comb(for_comb);
+
+    // Whether every other engine says the same as `pattern`,
+    // and both strides reject at the same byte
+    const auto agree = [&](const char *_item, const bool &_r) {
+        size_t scanned = 0, strided_scanned = 0;
+        const size_t length = strlen(_item);
+        const std::string padded =
+            std::string("#") + _item + "#";
+        return pattern.search(_item) == graph.search(_item) &&
+               pattern.search(padded) == graph.search(padded) &&
+               pattern.search(padded) == dense.search(padded) &&
+               dense.match(_item) == _r &&
+               frozen.match(_item, length, scanned) == _r &&
+               strided.match(_item, length, strided_scanned) ==
+                   _r &&
+               scanned == strided_scanned &&
+               comb.match(_item, length) == _r &&
+               regex_match(graph, _item) == _r &&
+               regex_match(graph.graph(), _item) == _r;
+    };
+
     // Run positive
     for (const auto &item : _should_pass)
     {
@@ -67,7 +107,7 @@ void test_regex(
 
         ++n;
 
-        if (!r)
+        if (!r || !agree(item, r))
         {
             failures.push_back(item);
         }
@@ -85,7 +125,7 @@ void test_regex(
 
         ++n;
 
-        if (r)
+        if (r || !agree(item, r))
         {
             failures.push_back(item);
         }
@@ -114,60 +154,1196 @@ void test_regex(
               << "\n\n";
 }
 
-////////////////////////////////////////////////////////////////
-// Main function
+// Whether two frozen tables are the same automaton, state for
+// state.
+static bool same_table(const FrozenRegex &_a,
+                       const FrozenRegex &_b)
+{
+    if (_a.state_count() != _b.state_count() ||
+        _a.start_state() != _b.start_state())
+    {
+        return false;
+    }
+    for (uint32_t s = 0; s < _a.state_count(); ++s)
+    {
+        if (_a.is_accepting(s) != _b.is_accepting(s))
+        {
+            return false;
+        }
+        for (int c = 0; c < 256; ++c)
+        {
+            if (_a.next_state(s, c) != _b.next_state(s, c))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
 
-int main()
+/*
+Asserts that compiling a pattern twice gives the same automaton,
+that `|` alternates at the top level, that an escape inside a
+group is honoured, and that malformed patterns throw.
+*/
+void test_compiler()
+{
+    for (const auto &c : regex_corpus)
+    {
+        const std::string expanded =
+            re_manager.perform_substitutions(c.pattern);
+        RegexGraph first =
+            compile_regex_graph(expanded.c_str());
+        RegexGraph second =
+            compile_regex_graph(expanded.c_str());
+        if (!same_table(freeze_regex(first),
+                        freeze_regex(second)))
+        {
+            throw std::runtime_error(
+                "Compiling /" + expanded + "/ twice differed!");
+        }
+    }
+
+    const RegEx either = compile_regex("ab|cd");
+    const RegEx escaped = compile_regex("(a\\+)+");
+    if (!regex_match(either, "ab") ||
+        !regex_match(either, "cd") ||
+        regex_match(either, "ab|cd") ||
+        !regex_match(escaped, "a+a+") ||
+        regex_match(escaped, "aa"))
+    {
+        throw std::runtime_error("Compiler semantics changed!");
+    }
+
+    for (const char *bad : {"(ab", "ab)", "*a", "a|+", "a\\"})
+    {
+        bool threw = false;
+        try
+        {
+            compile_regex(bad);
+        }
+        catch (const std::runtime_error &)
+        {
+            threw = true;
+        }
+        if (!threw)
+        {
+            throw std::runtime_error(
+                std::string("Malformed pattern /") + bad +
+                "/ compiled!");
+        }
+    }
+}
+
+/*
+Asserts that the pattern cache respects its memory budget.
+*/
+void test_memory_budget()
+{
+    RegexManager manager;
+
+    auto small = manager.get_regex("abc");
+    const size_t small_bytes = manager.memory_usage().total();
+    if (small->memory_usage().total() == 0 ||
+        manager.get_regex("abc") != small)
+    {
+        throw std::runtime_error(
+            "Pattern cache is not reused!");
+    }
+
+    // Room for roughly one small pattern: older ones get
+    // evicted
+    manager.set_memory_budget(small_bytes * 3 / 2);
+    manager.get_regex("abd");
+    if (manager.cache_size() != 1 ||
+        manager.memory_usage().total() >
+            manager.get_memory_budget())
+    {
+        throw std::runtime_error("Memory budget was exceeded!");
+    }
+
+    // A pattern which can never fit is refused
+    bool refused = false;
+    try
+    {
+        manager.get_regex("\\w+@\\w+\\.\\w+");
+    }
+    catch (const std::runtime_error &)
+    {
+        refused = true;
+    }
+
+    if (!refused || !regex_match(*small, "abc"))
+    {
+        throw std::runtime_error(
+            "Oversized pattern was cached!");
+    }
+
+    std::cout << "Memory budget: " << small_bytes
+              << " bytes per small pattern\n\n";
+}
+
+/*
+Asserts that per-pattern metrics count concurrent matches
+exactly, and can be exported.
+*/
+void test_metrics()
+{
+    RegexManager manager;
+    const int threads = 4, reps = 1000;
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&]() {
+            for (int j = 0; j < reps; ++j)
+            {
+                manager.match("\\d+", "123");
+                manager.match("\\d+", "12a45");
+                manager.match("\\d+", "");
+            }
+        });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    const auto snapshot = manager.metrics_snapshot();
+    const uint64_t n = threads * reps;
+    uint64_t histogram_total = 0;
+    for (const auto &count : snapshot.at(0).latency)
+    {
+        histogram_total += count;
+    }
+
+    if (snapshot.size() != 1 || snapshot[0].pattern != "\\d+" ||
+        snapshot[0].attempted != 3 * n ||
+        snapshot[0].succeeded != n ||
+        snapshot[0].early_rejects != n ||
+        snapshot[0].bytes_scanned != 6 * n ||
+        histogram_total != 3 * n)
+    {
+        throw std::runtime_error("Metrics miscounted!");
+    }
+
+    // Export
+    const std::string path = "regex_main_metrics.prom";
+    const std::string expected =
+        "regex_matches_attempted_total{pattern=\"\\\\d+\"} " +
+        std::to_string(3 * n) + "\n";
+    std::stringstream written;
+    if (manager.write_metrics(path))
+    {
+        written << std::ifstream(path).rdbuf();
+        std::remove(path.c_str());
+    }
+
+    if (written.str() != manager.metrics_prometheus() ||
+        written.str().find(expected) == std::string::npos ||
+        manager.push_metrics("/nonexistent/metrics.sock"))
+    {
+        throw std::runtime_error("Metrics export failed!");
+    }
+
+    std::cout << "Metrics: " << snapshot[0].attempted
+              << " matches counted across " << threads
+              << " threads\n\n";
+}
+
+/*
+Asserts that matches made through per-thread scratches are
+counted exactly once their scratches are gone, and that a
+scratch fetches its patterns again when the cache changes.
+*/
+void test_scratch()
+{
+    RegexManager manager;
+    const int threads = 4, reps = 1000;
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&]() {
+            RegexScratch scratch = manager.make_scratch();
+            for (int j = 0; j < reps; ++j)
+            {
+                manager.match(scratch, "\\d+", "123");
+                manager.match(scratch, "\\d+", "12a45");
+                manager.search(scratch, "\\w", "-x-");
+            }
+        });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    const auto snapshot = manager.metrics_snapshot();
+    const uint64_t n = threads * reps;
+    if (snapshot.size() != 1 ||
+        snapshot[0].attempted != 2 * n ||
+        snapshot[0].succeeded != n ||
+        snapshot[0].early_rejects != n)
+    {
+        throw std::runtime_error("Scratch metrics miscounted!");
+    }
+
+    // After the cache is cleared, the scratch fetches again
+    RegexScratch scratch = manager.make_scratch();
+    manager.prepare(scratch, "\\d+");
+    manager.clear_cache();
+    if (!manager.match(scratch, "\\d+", "42") ||
+        manager.cache_size() != 1 ||
+        scratch.pattern_count() != 1)
+    {
+        throw std::runtime_error("Scratch did not refetch!");
+    }
+
+    // A scratch only works with its own manager
+    bool threw = false;
+    try
+    {
+        re_manager.match(scratch, "a", "a");
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    if (!threw)
+    {
+        throw std::runtime_error("Scratch was shared!");
+    }
+
+    std::cout << "Scratch: " << snapshot[0].attempted
+              << " matches counted from " << threads
+              << " scratches\n\n";
+}
+
+/*
+Asserts that generated inputs are accepted or rejected as
+intended, and that path count weighting is uniform over the
+accepted strings of a length.
+*/
+void test_input_generator()
 {
-    re_manager.register_substitution("#{bin}", BINARY_RE);
-    re_manager.register_substitution("#{oct}", OCTAL_RE);
-    re_manager.register_substitution("#{dec}", DECIMAL_RE);
-    re_manager.register_substitution("#{hex}", HEX_RE);
+    size_t generated = 0;
+    for (const auto &c : regex_corpus)
+    {
+        RegEx pattern = re_manager.create_regex(c.pattern);
+        const FrozenRegex frozen =
+            freeze_regex(pattern.graph());
 
-    test_regex("a*b+c?d", {"bbd", "aaaabcd"}, {"aaacd", "abc"});
+        for (const auto weighting :
+             {InputGenerator::uniform_bytes,
+              InputGenerator::path_count})
+        {
+            InputGenerator gen(frozen, generated, weighting);
+            for (int i = 0; i < 16; ++i)
+            {
+                const auto yes = gen.accepted(0, 48);
+                const auto no = gen.near_miss(0, 48);
+                const bool yes_ok =
+                    !yes ||
+                    (frozen.match(*yes) &&
+                     regex_match(pattern, yes->c_str()));
+                const bool no_ok =
+                    !no || (!frozen.match(*no) &&
+                            !regex_match(pattern, no->c_str()));
+                if (!yes_ok || !no_ok)
+                {
+                    throw std::runtime_error(
+                        "Generated input misclassified for " +
+                        std::string(c.pattern));
+                }
+                generated += yes.has_value() + no.has_value();
+            }
+        }
+    }
 
-    test_regex("\\d+", {"123", "09876"}, {"", "123abc"});
+    // a*b* accepts 5 strings of length 4, which should be
+    // equally likely
+    RegexGraph pattern = compile_regex_graph("a*b*");
+    const FrozenRegex frozen = freeze_regex(pattern);
+    InputGenerator gen(frozen, 1, InputGenerator::path_count,
+                       "ab");
+    std::map<std::string, int> seen;
+    const int draws = 5000;
+    for (int i = 0; i < draws; ++i)
+    {
+        ++seen[gen.accepted(4).value()];
+    }
+    for (const auto &p : seen)
+    {
+        if (seen.size() != 5 || p.second < draws / 5 * 0.8 ||
+            p.second > draws / 5 * 1.2)
+        {
+            throw std::runtime_error(
+                "Path count weighting is not uniform!");
+        }
+    }
 
-    test_regex("\\w+", {"foobar", "BobErt"}, {"greg123"});
+    // With no bytes to draw from, there is nothing to generate
+    bool threw = false;
+    try
+    {
+        InputGenerator empty(frozen, 1,
+                             InputGenerator::path_count, "");
+    }
+    catch (const std::runtime_error &)
+    {
+        threw = true;
+    }
+    if (!threw)
+    {
+        throw std::runtime_error(
+            "Empty alphabet was accepted!");
+    }
 
-    test_regex("\\w+\\s\\w+", {"foo bbbar", "BobErt ROCKS"},
-               {"foobar", "foo ", " foo", "greg 123"});
+    std::cout << "Input generator: " << generated
+              << " corpus inputs classified correctly\n\n";
+}
 
-    // Email example
-    test_regex("(\\w|\\d)+@\\w+\\.\\w+",
-               {"jdehmel@outlook.com", "a@b.c"},
-               {"jdehmel@foobar@outlook.com", "1@2.c.d",
-                "jedehmel@ outlook. com"});
+/*
+Asserts that patterns are dispatched to the expected engines,
+and that `explain` reports them.
+*/
+void test_engine_dispatch()
+{
+    RegexOptions graph_only, no_shuffle, packed;
+    graph_only.dense_table_limit = 0;
+    no_shuffle.shuffle_state_limit = 0;
 
-    // Testing basics used for int literals
-    test_regex("(0+1)+", {"01001000101001"}, {"0100110011"});
-    test_regex("((0|1)+')*", {"11001100'1010'"},
-               {"11001100'101''"});
-    test_regex("(1+')*0+", {"1'1'11'11'00"}, {"'11'00", "11'"});
+    // A dense table here takes 1752 bytes, and a comb 1127
+    packed.dense_table_limit = 1500;
 
-    // Parshal int literal testing
-    test_regex(BINARY_RE,
-               {"0b1111'0000'1111'0000", "0B01011010101",
-                "0b101010'1'1"},
-               {"b1111'0000", "0v1111'0000", "0b1000'2011"});
+    const RegEx literal = compile_regex("abc\\.d");
+    const RegEx dense = compile_regex(
+        re_manager.perform_substitutions("\\d+").c_str(),
+        no_shuffle);
+    const RegEx shuffle = re_manager.create_regex("\\d+");
+    const RegEx graph = compile_regex("(ab|cd)*e", graph_only);
+    const RegEx comb = compile_regex(
+        "(alpha|bravo|charlie|delta|echo|foxtrot|golf|hotel)",
+        packed);
 
-    test_regex(OCTAL_RE, {"01'234'567'654", "0", "0'1'2'3"},
-               {"012345678", "01234567'"});
+    if (literal.engine() != engine_literal ||
+        dense.engine() != engine_dense ||
+        shuffle.engine() != engine_shuffle ||
+        comb.engine() != engine_comb ||
+        graph.engine() != engine_graph)
+    {
+        throw std::runtime_error("Unexpected engine chosen!");
+    }
 
-    test_regex(DECIMAL_RE,
-               {"10", "-123", "516", "-9999", "-19'92"},
-               {"0", "-0", "12349A"});
+    if (!literal.match("abc.d") || literal.match("abcxd") ||
+        literal.match("abc.") || !dense.match("0123") ||
+        dense.match("01a") || !shuffle.match("0123") ||
+        shuffle.match("01a") || !comb.match("foxtrot") ||
+        comb.match("foxtro") || comb.match("golfs") ||
+        !graph.match("abcdabe") || graph.match("abcd"))
+    {
+        throw std::runtime_error("Dispatched engine failed!");
+    }
 
-    test_regex(HEX_RE, {"0x12'34'56'67'9A'bC'dd'ee'FF", "0x0"},
-               {"0xG", "0x"});
+    // Several inputs at once, in pairs, with a lone last one
+    const std::string digits(100, '7'), bad = digits + "x";
+    const std::vector<std::string_view> texts = {
+        "0123", "01a", "", digits, "9", bad, digits};
+    bool results[7];
+    shuffle.match_many(texts.data(), texts.size(), results);
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        if (results[i] != dense.match(texts[i]))
+        {
+            throw std::runtime_error("match_many failed!");
+        }
+    }
+
+    for (const RegEx *r :
+         {&literal, &dense, &shuffle, &comb, &graph})
+    {
+        const std::string report = r->explain();
+        const std::string expected =
+            std::string("engine:    ") +
+            regex_engine_name(r->engine());
+        if (report.find(expected) == std::string::npos)
+        {
+            throw std::runtime_error("Bad explanation:\n" +
+                                     report);
+        }
+    }
+
+    std::cout << literal.explain() << '\n'
+              << dense.explain() << '\n'
+              << shuffle.explain() << '\n'
+              << comb.explain() << '\n'
+              << graph.explain() << '\n';
+}
+
+/*
+Asserts that an escaped `.` matches only a dot on every engine,
+and through the manager, whichever engine the pattern is given.
+*/
+void test_escaped_dot()
+{
+    RegexOptions graph_only, no_shuffle;
+    graph_only.dense_table_limit = 0;
+    no_shuffle.shuffle_state_limit = 0;
+
+    for (const char *pattern :
+         {"a\\.b", "(a)\\.b", "a\\.b+", "a\\.bc?"})
+    {
+        const RegEx chosen = compile_regex(pattern);
+        const RegEx dense = compile_regex(pattern, no_shuffle);
+        const RegEx graph = compile_regex(pattern, graph_only);
+        RegexGraph nodes = compile_regex_graph(pattern);
+        const FrozenRegex frozen(nodes);
+        const ShuffleRegex shuffle(frozen);
+        const CombRegex comb(frozen);
+
+        for (const char *text : {"a.b", "axb"})
+        {
+            const bool dot = text[1] == '.';
+            if (chosen.match(text) != dot ||
+                dense.match(text) != dot ||
+                graph.match(text) != dot ||
+                frozen.match(text) != dot ||
+                shuffle.match(text) != dot ||
+                comb.match(text) != dot ||
+                regex_match(nodes, text) != dot ||
+                re_manager.match(pattern, text) != dot)
+            {
+                throw std::runtime_error(
+                    std::string("Escaped dot in /") + pattern +
+                    "/ failed on " + text + "!");
+            }
+        }
+    }
+}
+
+/*
+Asserts that searching finds the leftmost, then longest, match
+with every engine.
+*/
+void test_search()
+{
+    RegexOptions graph_only, each_start, packed;
+    graph_only.dense_table_limit = 0;
+    each_start.search_table_limit = 0;
+    packed.dense_table_limit = 1500;
+
+    const std::string hay = "a haystack with a needle in it";
+    const RegEx needle = compile_regex("needle");
+    const RegEx single = compile_regex("k");
+    const RegEx empty = compile_regex("");
+    const RegEx digits = re_manager.create_regex("\\d+");
+    const RegEx graph = compile_regex("(ab|cd)*e", graph_only);
+    const RegEx dense = compile_regex("(ab|cd)*e");
+    const RegEx retried =
+        compile_regex("(ab|cd)*e", each_start);
+    const RegEx comb = compile_regex(
+        "(alpha|bravo|charlie|delta|echo|foxtrot|golf|hotel)",
+        packed);
+
+    // The earliest match to end is not the leftmost
+    const RegEx overlap = compile_regex("abcd|c");
+
+    const std::vector<
+        std::pair<std::optional<RegexSpan>, RegexSpan>>
+        found = {
+            {needle.search(hay), {18, 6}},
+            {single.search(hay), {9, 1}},
+            {empty.search(hay), {0, 0}},
+            {digits.search("abc 0123 45"), {4, 4}},
+            {graph.search("xxabcdexe"), {2, 5}},
+            {dense.search("xxabcdexe"), {2, 5}},
+            {retried.search("xxabcdexe"), {2, 5}},
+            {comb.search("a golfing echo"), {2, 4}},
+            {overlap.search("xabcd"), {1, 4}},
+            {overlap.search("abcx"), {2, 1}},
+            {re_manager.search("needle", hay), {18, 6}},
+        };
+    for (const auto &p : found)
+    {
+        if (p.first != p.second)
+        {
+            throw std::runtime_error(
+                "Search found the wrong span!");
+        }
+    }
+
+    if (needle.search("needl") || needle.search("needlE") ||
+        digits.search("none") || graph.search("abcd") ||
+        dense.search("abcd") || retried.search("abcd") ||
+        comb.search("gol ech") ||
+        empty.search("").value().length)
+    {
+        throw std::runtime_error("Search found a false match!");
+    }
+
+    std::cout << "Search: " << found.size()
+              << " spans found\n\n";
+}
+
+/*
+Asserts that accelerated states are found where expected, and
+that skipping through them gives the same answers as stepping
+through the table a byte at a time.
+*/
+void test_acceleration()
+{
+    // Each pattern, and how many states it should accelerate
+    const std::vector<std::pair<const char *, size_t>> cases = {
+        {".*@.*", 2},
+        {"x.*yz", 1},
+        {"x.*(y|z)@", 1},
+        {"x.*(a|b|c)d", 1},
+        {"x.*(a|b|c|d)@", 0},
+        {"(a|b|c)*d", 0},
+    };
+    const std::string alphabet = "abcdxyz@";
+
+    size_t checked = 0;
+    std::minstd_rand rng(87);
+    for (const auto &[pattern, accelerated] : cases)
+    {
+        RegexGraph graph = compile_regex_graph(pattern);
+        const FrozenRegex frozen = freeze_regex(graph);
+        if (frozen.accelerated_count() != accelerated)
+        {
+            throw std::runtime_error(
+                std::string("Wrong acceleration for ") +
+                pattern + "!");
+        }
+
+        for (size_t length = 0; length < 512; length += 7)
+        {
+            std::string text = length ? "x" : "";
+            while (text.size() < length)
+            {
+                text.push_back(alphabet[rng() % (rng() % 64 == 0
+                                                     ? 8
+                                                     : 3)]);
+            }
+
+            // The same walk, without skipping
+            uint32_t state = frozen.start_state();
+            size_t longest = frozen.is_accepting(state)
+                                 ? 0
+                                 : FrozenRegex::npos;
+            for (size_t i = 0; i < text.size() && state; ++i)
+            {
+                state = frozen.next_state(state, text[i]);
+                if (frozen.is_accepting(state))
+                {
+                    longest = i + 1;
+                }
+            }
+
+            const size_t prefix =
+                frozen.longest_prefix(text.data(), text.size());
+            if (frozen.match(text) !=
+                    frozen.is_accepting(state) ||
+                prefix != longest)
+            {
+                throw std::runtime_error(
+                    std::string("Skipping changed a match: ") +
+                    pattern + "!");
+            }
+            ++checked;
+        }
+    }
+
+    std::cout << "Acceleration: " << checked
+              << " inputs matched alike\n\n";
+}
+
+/*
+Asserts that frozen tables store state ids in the narrowest
+width which holds them.
+*/
+void test_id_widths()
+{
+    const std::vector<std::pair<std::string, size_t>> cases = {
+        {"a*b", 1},
+        {re_manager.perform_substitutions("\\w+@\\w+"), 2},
+    };
+
+    for (const auto &[pattern, width] : cases)
+    {
+        RegexGraph graph = compile_regex_graph(pattern.c_str());
+        const FrozenRegex frozen = freeze_regex(graph);
+        const size_t entries =
+            frozen.state_count() * frozen.class_count();
+        if (frozen.id_width() != width ||
+            FrozenRegex::id_bytes(entries) != width)
+        {
+            throw std::runtime_error("Wrong id width for " +
+                                     pattern + "!");
+        }
+    }
+
+    std::cout << "Id widths: " << cases.size()
+              << " patterns stored narrowly\n\n";
+}
+
+/*
+Asserts that in UTF-8 mode `.` matches exactly the encodings of
+characters, NUL included as in byte mode, that a character of
+several bytes is repeated whole, that an escaped `.` is only a
+dot, and that the body of `.*` is still skipped through.
+*/
+void test_utf8()
+{
+    RegexOptions utf8;
+    utf8.utf8 = true;
+
+    // Every character, and every surrogate, as bytes
+    const RegEx any = compile_regex(".", utf8);
+    size_t characters = 0;
+    for (uint32_t c = 0; c <= 0x10FFFF; ++c)
+    {
+        std::string bytes;
+        if (c < 0x80)
+        {
+            bytes = {(char)c};
+        }
+        else if (c < 0x800)
+        {
+            bytes = {(char)(0xC0 | c >> 6),
+                     (char)(0x80 | (c & 0x3F))};
+        }
+        else if (c < 0x10000)
+        {
+            bytes = {(char)(0xE0 | c >> 12),
+                     (char)(0x80 | (c >> 6 & 0x3F)),
+                     (char)(0x80 | (c & 0x3F))};
+        }
+        else
+        {
+            bytes = {(char)(0xF0 | c >> 18),
+                     (char)(0x80 | (c >> 12 & 0x3F)),
+                     (char)(0x80 | (c >> 6 & 0x3F)),
+                     (char)(0x80 | (c & 0x3F))};
+        }
+
+        const bool surrogate = c >= 0xD800 && c <= 0xDFFF;
+        if (any.match(bytes) == surrogate)
+        {
+            throw std::runtime_error(
+                "UTF-8 wildcard failed on U+" +
+                std::to_string(c) + "!");
+        }
+        characters += !surrogate;
+    }
+
+    // Every string of one or two bytes
+    for (int a = 0; a < 256; ++a)
+    {
+        for (int b = -1; b < 256; ++b)
+        {
+            std::string bytes = {(char)a};
+            if (b >= 0)
+            {
+                bytes.push_back((char)b);
+            }
+            const bool valid =
+                utf8_character((const uint8_t *)bytes.data(),
+                               bytes.size()) == bytes.size();
+            if (any.match(bytes) != valid)
+            {
+                throw std::runtime_error(
+                    "UTF-8 wildcard failed on bytes!");
+            }
+        }
+    }
+
+    const RegEx star = compile_regex("x\xC3\xA9*y", utf8);
+    const RegEx wide = compile_regex("a.b", utf8);
+    const RegEx bytes = compile_regex("a.b");
+    const RegEx dot = compile_regex("a\\.b*", utf8);
+    if (!star.match("xy") ||
+        !star.match("x\xC3\xA9\xC3\xA9y") ||
+        star.match("x\xC3\xA9\xA9y") ||
+        !wide.match("a\xE2\x82\xAC"
+                    "b") ||
+        !wide.match("a.b") || !dot.match("a.") ||
+        dot.match("ax") ||
+        wide.match("a\xC3"
+                   "b") ||
+        bytes.match("a\xC3\xA9"
+                    "b"))
+    {
+        throw std::runtime_error("UTF-8 mode failed!");
+    }
+
+    // `.` matches NUL in either mode
+    const std::string nul("a\0b", 3);
+    if (!wide.match(nul) || !bytes.match(nul) ||
+        wide.search(nul) != bytes.search(nul))
+    {
+        throw std::runtime_error("NUL wildcard failed!");
+    }
+
+    for (const char *bad :
+         {"\xA9", "a\xC3", "\xC0\xAF", "\xED\xA0\x80"})
+    {
+        bool threw = false;
+        try
+        {
+            compile_regex(bad, utf8);
+        }
+        catch (const std::runtime_error &)
+        {
+            threw = true;
+        }
+        if (!threw)
+        {
+            throw std::runtime_error(
+                "Invalid UTF-8 pattern compiled!");
+        }
+    }
+
+    RegexGraph graph = compile_regex_graph(".*@", {true});
+    if (freeze_regex(graph).accelerated_count() != 1)
+    {
+        throw std::runtime_error(
+            "UTF-8 wildcard was not accelerated!");
+    }
+
+    std::cout << "UTF-8: " << characters
+              << " characters matched by " << any.state_count()
+              << " states\n\n";
+}
+
+// Folding case should match what a hand-expanded pattern
+// matches, with a table no larger than the unfolded one.
+void test_fold_case()
+{
+    RegexOptions fold;
+    fold.fold_case = true;
+
+    const RegEx folded = compile_regex("(ab|c)+d", fold);
+    const RegEx expanded =
+        compile_regex("((a|A)(b|B)|(c|C))+(d|D)");
+    const RegEx plain = compile_regex("(ab|c)+d");
+    for (const char *s : {"abd", "ABD", "aBcCd", "AbcD", "abD",
+                          "a", "ab", "d", "aBx", "xabd"})
+    {
+        if (folded.match(s) != expanded.match(s))
+        {
+            throw std::runtime_error(
+                std::string("Folded case failed on ") + s +
+                "!");
+        }
+    }
+    if (folded.state_count() != plain.state_count() ||
+        folded.memory_usage().total() !=
+            plain.memory_usage().total())
+    {
+        throw std::runtime_error(
+            "Folded case grew the table!");
+    }
+
+    // Literals with letters are no longer compared bytewise
+    const RegEx word = compile_regex("hello, world", fold);
+    const RegEx digits = compile_regex("1234", fold);
+    const auto span = word.search("say HeLLo, WORLD!");
+    if (word.engine() == engine_literal ||
+        digits.engine() != engine_literal || !span ||
+        *span != RegexSpan{4, 12} ||
+        word.match("hellx, world"))
+    {
+        throw std::runtime_error("Folded literal failed!");
+    }
+
+    // Only ASCII letters fold
+    fold.utf8 = true;
+    const RegEx accent =
+        compile_regex("\xC3\xA9t\xC3\xA9", fold);
+    if (!accent.match("\xC3\xA9T\xC3\xA9") ||
+        accent.match("\xC3\x89t\xC3\x89"))
+    {
+        throw std::runtime_error("Folded UTF-8 failed!");
+    }
+
+    std::cout << "Folded case: " << folded.state_count()
+              << " states in "
+              << folded.memory_usage().total()
+              << " bytes, as unfolded\n\n";
+}
+
+// The edit distance from `_literal` to `_text` by the usual
+// table, or when searching, the best of any part of `_text`.
+static FuzzyMatch edit_distance(const std::string &_literal,
+                                const std::string &_text,
+                                const bool &_search)
+{
+    const size_t m = _literal.size();
+    std::vector<size_t> column(m + 1);
+    for (size_t i = 0; i <= m; ++i)
+    {
+        column[i] = i;
+    }
+
+    FuzzyMatch best = {0, m};
+    for (size_t j = 0; j < _text.size(); ++j)
+    {
+        size_t diagonal = column[0];
+        column[0] = _search ? 0 : j + 1;
+        for (size_t i = 1; i <= m; ++i)
+        {
+            const size_t above = column[i];
+            column[i] = std::min(
+                {above + 1, column[i - 1] + 1,
+                 diagonal + (_literal[i - 1] != _text[j])});
+            diagonal = above;
+        }
+        if (!_search || column[m] < best.distance)
+        {
+            best = {j + 1, column[m]};
+        }
+    }
+    return best;
+}
+
+// Both fuzzy matchers should agree with the edit distance
+// table, within the edits allowed.
+void test_fuzzy()
+{
+    constexpr size_t k = 2;
+    std::minstd_rand rng(96);
+    const auto random = [&](const size_t &_length,
+                            const std::string &_alphabet) {
+        std::string out;
+        for (size_t i = 0; i < _length; ++i)
+        {
+            out.push_back(_alphabet[rng() % _alphabet.size()]);
+        }
+        return out;
+    };
+
+    // Literals of 64 bytes or fewer use bit masks, and in
+    // parentheses or longer, the table
+    size_t checked = 0;
+    for (const std::string &literal :
+         {std::string("hello"), std::string("abcab"),
+          random(64, "ab"), random(65, "ab")})
+    {
+        const FuzzyRegex masks(literal, k);
+        const FuzzyRegex table("(" + literal + ")", k);
+        if (masks.is_literal() != (literal.size() <= 64) ||
+            table.is_literal())
+        {
+            throw std::runtime_error("Wrong fuzzy matcher!");
+        }
+
+        for (size_t i = 0; i < 200; ++i)
+        {
+            const std::string text =
+                i % 2 ? random(rng() % (literal.size() + 8),
+                               "abcehlo")
+                      : literal;
+            std::string edited = text;
+            for (size_t e = rng() % 4; e > 0 && !edited.empty();
+                 --e)
+            {
+                edited[rng() % edited.size()] = 'x';
+            }
+
+            for (const bool search : {false, true})
+            {
+                const FuzzyMatch expected =
+                    edit_distance(literal, edited, search);
+                std::optional<FuzzyMatch> found[2];
+                for (int which = 0; which < 2; ++which)
+                {
+                    const FuzzyRegex &f = which ? table : masks;
+                    if (search)
+                    {
+                        found[which] = f.search(edited);
+                    }
+                    else if (const auto d = f.distance(edited))
+                    {
+                        found[which] = {edited.size(), *d};
+                    }
+                }
+
+                if (found[0] != found[1] ||
+                    (expected.distance <= k
+                         ? found[0] != expected
+                         : found[0].has_value()))
+                {
+                    throw std::runtime_error(
+                        "Fuzzy matching failed on " + edited +
+                        " for " + literal + "!");
+                }
+                ++checked;
+            }
+        }
+    }
+
+    // Patterns, and folded case
+    RegexOptions fold;
+    fold.fold_case = true;
+    const FuzzyRegex colour("colou?r", 1);
+    const FuzzyRegex hello("hello", 1, fold);
+    const auto span = hello.search("say HELO!");
+    if (colour.distance("color") != 0 ||
+        colour.distance("colouur") != 1 ||
+        colour.distance("clr") || !span ||
+        *span != FuzzyMatch{8, 1} ||
+        FuzzyRegex("hello", 1).search("say HELO!"))
+    {
+        throw std::runtime_error("Fuzzy patterns failed!");
+    }
+
+    std::cout << "Fuzzy: " << checked
+              << " distances matched the table\n\n";
+}
+
+// Replacement should agree with splicing in each search result
+// by hand, on every engine.
+void test_replace()
+{
+    RegexOptions graph_only, utf8;
+    graph_only.dense_table_limit = 0;
+    utf8.utf8 = true;
+
+    const struct
+    {
+        const char *pattern, *text, *with, *expected;
+        RegexOptions options;
+    } cases[] = {
+        {"(0|1|2|3|4|5|6|7|8|9)+", "card 4111 and 12", "[$0]",
+         "card [4111] and [12]", {}},
+        {"secret", "a secret, secret!", "***",
+         "a ***, ***!", {}},
+        {"ab*", "abbbxaab", "($&)$$", "(abbb)$x(a)$(ab)$", {}},
+        {"a*", "baa", "X", "XbXX", {}},
+        {"a*", "baa", "X", "XbXX", graph_only},
+        {"(x|y)", "", "-", "", {}},
+        {"a?", "\xC3\xA9", "-", "-\xC3\xA9-", utf8},
+    };
+
+    size_t checked = 0;
+    for (const auto &c : cases)
+    {
+        const RegEx pattern =
+            compile_regex(c.pattern, c.options);
+        const std::string out =
+            regex_replace(pattern, c.text, c.with);
+        if (out != c.expected)
+        {
+            throw std::runtime_error(
+                std::string("Replacing /") + c.pattern +
+                "/ gave '" + out + "'!");
+        }
+        ++checked;
+    }
+
+    if (re_manager.replace("\\d+", "pin 1234", "#") !=
+        "pin #")
+    {
+        throw std::runtime_error("Managed replace failed!");
+    }
+
+    // Captures are refused by name
+    for (const char *bad : {"$1", "$9", "$", "a$b"})
+    {
+        bool threw = false;
+        try
+        {
+            regex_replace(compile_regex("a"), "a", bad);
+        }
+        catch (const std::runtime_error &e)
+        {
+            const bool capture = bad[1] >= '1' && bad[1] <= '9';
+            threw = capture == (strstr(e.what(), "Capture") !=
+                                nullptr);
+        }
+        if (!threw)
+        {
+            throw std::runtime_error(
+                std::string("Bad replacement ") + bad +
+                " was accepted!");
+        }
+    }
+
+    std::cout << "Replace: " << checked << " cases\n\n";
+}
+
+// Lazy ranges of matches and splits should be forward views
+// which compose with std::views.
+void test_ranges()
+{
+    static_assert(std::ranges::forward_range<RegexMatches>);
+    static_assert(std::ranges::view<RegexSplit>);
+
+    const auto joined = [](auto &&_range) {
+        std::string out;
+        for (const std::string_view &part : _range)
+        {
+            out += "[" + std::string(part) + "]";
+        }
+        return out;
+    };
+
+    const RegEx comma = compile_regex(",");
+    const RegEx digits =
+        compile_regex("(0|1|2|3|4|5|6|7|8|9)+");
+    const RegEx as = compile_regex("a*");
+    const struct
+    {
+        std::string got, expected;
+    } cases[] = {
+        {joined(regex_split(comma, "a,b,,c")), "[a][b][][c]"},
+        {joined(regex_split(comma, "")), "[]"},
+        {joined(regex_split(comma, ",")), "[][]"},
+        {joined(regex_split(as, "baa")), "[][b][][]"},
+        {joined(regex_matches(as, "baa")), "[][aa][]"},
+        {joined(regex_matches(digits, "x12y3")), "[12][3]"},
+        {joined(regex_matches(digits, "none")), ""},
+        {joined(regex_split(comma, "id,name,age") |
+                std::views::drop(1) | std::views::take(1)),
+         "[name]"},
+    };
+    for (const auto &c : cases)
+    {
+        if (c.got != c.expected)
+        {
+            throw std::runtime_error("Range gave " + c.got +
+                                     ", not " + c.expected +
+                                     "!");
+        }
+    }
+
+    // Restarting a range, and counting with std::ranges
+    const RegexSplit fields = regex_split(comma, "1,22,333");
+    if (std::ranges::distance(fields) != 3 ||
+        *std::ranges::next(fields.begin(), 2) != "333" ||
+        fields.front() != "1")
+    {
+        throw std::runtime_error("Split range failed!");
+    }
+
+    std::cout << "Ranges: " << std::size(cases)
+              << " splits and matches\n\n";
+}
+
+// Cached results should always equal the pattern's own, even
+// when inputs collide on a slot, and repeats should hit.
+void test_match_cache()
+{
+    const auto pattern = std::make_shared<const RegEx>(
+        re_manager.create_regex("\\w+@\\w+\\.com"));
+    MatchCache cache(pattern, 64, 16, 4);
+    if (cache.capacity() != 64 || cache.shard_number() != 4)
+    {
+        throw std::runtime_error("Match cache misshapen!");
+    }
+
+    // Far more distinct inputs than entries, each seen thrice
+    std::minstd_rand rng(100);
+    const std::string alphabet = "ab@.com";
+    std::vector<std::string> inputs = {"a@b.com", "",
+                                       "ab@cd.com.org.long"};
+    while (inputs.size() < 1000)
+    {
+        std::string s;
+        for (size_t i = rng() % 12; i > 0; --i)
+        {
+            s.push_back(alphabet[rng() % alphabet.size()]);
+        }
+        inputs.push_back(s);
+    }
+
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        for (const std::string &s : inputs)
+        {
+            for (int repeat = 0; repeat < 3; ++repeat)
+            {
+                if (cache.match(s) != pattern->match(s))
+                {
+                    throw std::runtime_error(
+                        "Match cache disagreed on " + s + "!");
+                }
+            }
+        }
+    }
+
+    const MatchCacheStats stats = cache.stats();
+    if (stats.hits + stats.misses + stats.bypassed != 9000 ||
+        stats.bypassed != 9 || stats.hit_rate() < 0.6)
+    {
+        throw std::runtime_error("Match cache miscounted!");
+    }
+
+    // A default string_view has a null data pointer
+    for (int repeat = 0; repeat < 2; ++repeat)
+    {
+        if (cache.match(std::string_view()) !=
+            pattern->match(std::string_view()))
+        {
+            throw std::runtime_error(
+                "Match cache failed on no input!");
+        }
+    }
+
+    // Slots hold 32-bit lengths
+    if constexpr (sizeof(size_t) > sizeof(uint32_t))
+    {
+        bool threw = false;
+        try
+        {
+            MatchCache huge(pattern, 1, (size_t)UINT32_MAX + 1);
+        }
+        catch (const std::runtime_error &)
+        {
+            threw = true;
+        }
+        if (!threw)
+        {
+            throw std::runtime_error(
+                "Match cache took a 33-bit length!");
+        }
+    }
+
+    std::cout << "Match cache: "
+              << (int)(100 * stats.hit_rate()) << "% of "
+              << 9000 << " lookups hit\n\n";
+}
+
+////////////////////////////////////////////////////////////////
+// Main function
+
+int main()
+{
+    register_corpus_substitutions(re_manager);
+    test_compiler();
+
+    for (const auto &c : regex_corpus)
+    {
+        test_regex(c.pattern, c.should_pass, c.should_fail);
+    }
 
-    // Int literal example
-    test_regex(INT_RE,
-               {"123", "0123", "0x123", "0B1010'1010'1", "100",
-                "0x0", "201", "200"},
-               {"foo", "0xGorilla", "'0101010'", "0x", "0b", "",
-                "char", "0b1010'1002", "0xx0", "0xG", "10.0",
-                "100 0"});
+    test_memory_budget();
+    test_metrics();
+    test_scratch();
+    test_input_generator();
+    test_engine_dispatch();
+    test_escaped_dot();
+    test_search();
+    test_acceleration();
+    test_id_widths();
+    test_utf8();
+    test_fold_case();
+    test_fuzzy();
+    test_replace();
+    test_ranges();
+    test_match_cache();
 
     std::cout << "All tests of RegEx via TokEx passed.\n";
 
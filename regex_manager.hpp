@@ -5,14 +5,112 @@ Defines the RegexManager class.
 #pragma once
 
 #include "regex.hpp"
+#include "regex_metrics.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
+
+class RegexManager;
+
+/*
+Scratch space for one thread's matches through a RegexManager,
+in the manner of Hyperscan's scratch: made once per thread with
+`RegexManager::make_scratch`, and passed to each match. It holds
+each pattern the thread uses, compiled and pinned, and the
+thread's own metrics for it, so that once a pattern has been
+used (or prepared), matching it takes no lock, allocates
+nothing, and writes nothing another thread reads.
+
+Metrics are added to the manager's every `merge_interval`
+matches of a pattern, on `flush`, and when the scratch is
+destroyed, so a snapshot may lag behind by up to that many.
+A scratch notices when the manager's substitutions or cache
+change, and fetches its patterns again. Patterns it holds stay
+alive after eviction, as those held by callers do.
+*/
+class RegexScratch
+{
+  public:
+    // Matches of a pattern recorded between merges.
+    static constexpr uint64_t merge_interval = 1024;
+
+    RegexScratch(RegexScratch &&) = default;
+    RegexScratch(const RegexScratch &) = delete;
+    RegexScratch &operator=(const RegexScratch &) = delete;
+
+    ~RegexScratch()
+    {
+        flush();
+    }
+
+    // Add the metrics recorded here to the manager's.
+    void flush() noexcept
+    {
+        for (auto &p : patterns)
+        {
+            if (p.second.shared != nullptr)
+            {
+                p.second.shared->merge(p.second.local);
+            }
+        }
+    }
+
+    // The number of patterns held.
+    size_t pattern_count() const noexcept
+    {
+        return patterns.size();
+    }
+
+  protected:
+    friend class RegexManager;
+
+    explicit RegexScratch(const RegexManager *_owner)
+        : owner(_owner)
+    {
+    }
+
+    struct Pattern
+    {
+        // The shared metrics are only made once the pattern is
+        // matched, as searches record none.
+        std::shared_ptr<const RegEx> regex;
+        std::shared_ptr<PatternMetrics> shared;
+        LocalPatternMetrics local;
+
+        // The manager's generation when this was fetched.
+        uint64_t generation = 0;
+    };
+
+    const RegexManager *owner;
+
+    // By pattern as requested. Lookups take a string_view.
+    std::map<std::string, Pattern, std::less<>> patterns;
+};
 
 /*
 Performs substitutions and composition for regular expressions.
 This is a factory for regular expressions which keeps an
 internal bank of named substitutions; When a regular expression
 is requested, it performs any necessary substitutions.
+
+Compiled patterns requested through `get_regex`, `match`,
+`search` or `replace` are cached. The cache may be given a byte
+budget, in which case the least recently used patterns are
+evicted to make room, and patterns which could never fit are
+refused. Matches made through `match` also record per-pattern
+metrics (see regex_metrics.hpp). Threads serving many requests
+should match through a scratch of their own (see RegexScratch),
+which avoids the cache lock and shared counters on every match.
 */
 class RegexManager
 {
@@ -33,7 +131,10 @@ class RegexManager
     void register_substitution(const std::string &_name,
                                const std::string &_value)
     {
-        substitutions[_name] = perform_substitutions(_value);
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        substitutions[_name] = substitute(_value);
+        expansions.clear();
+        ++generation;
     }
 
     // Compile a regular expression.
@@ -49,18 +150,306 @@ class RegexManager
                        const std::string &_pattern)
     {
         register_substitution(_name, _pattern);
-        return create_regex(substitutions[_name]);
+        std::string value;
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            value = substitutions[_name];
+        }
+        return create_regex(value);
     }
 
     const std::map<const std::string, std::string>
     get_substitutions() const
     {
+        std::lock_guard<std::mutex> lock(cache_mutex);
         return substitutions;
     }
 
-  protected:
+    // Expand every registered substitution in the given text.
     std::string perform_substitutions(
         const std::string &_on) const
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return substitute(_on);
+    }
+
+    // Fetch a compiled regular expression from the cache,
+    // compiling it on a miss. Throws if the compiled pattern is
+    // larger than the memory budget on its own.
+    std::shared_ptr<RegEx> get_regex(
+        const std::string &_pattern)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return fetch(expand(_pattern)).regex;
+    }
+
+    // Report the executor chosen for a (cached) pattern. See
+    // RegEx::explain.
+    std::string explain(const std::string &_pattern)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return fetch(expand(_pattern)).regex->explain();
+    }
+
+    // Match text against a (cached) pattern, recording metrics
+    // for the pattern. This is safe to call from many threads
+    // at once.
+    bool match(const std::string &_pattern,
+               const std::string_view &_text)
+    {
+        std::shared_ptr<const RegEx> regex;
+        std::shared_ptr<PatternMetrics> stats;
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            regex = fetch(expand(_pattern)).regex;
+            stats = metrics_for(_pattern);
+        }
+        return timed_match(*regex, _text, *stats);
+    }
+
+    // Scratch space for one thread. See RegexScratch.
+    RegexScratch make_scratch() const
+    {
+        return RegexScratch(this);
+    }
+
+    // Fetch a pattern into a scratch ahead of its first match,
+    // so that matching it allocates nothing.
+    void prepare(RegexScratch &_scratch,
+                 const std::string_view &_pattern)
+    {
+        held(_scratch, _pattern, true);
+    }
+
+    // As `match`, but through a scratch. Once the pattern is
+    // held, this takes no lock and allocates nothing.
+    bool match(RegexScratch &_scratch,
+               const std::string_view &_pattern,
+               const std::string_view &_text)
+    {
+        RegexScratch::Pattern &p =
+            held(_scratch, _pattern, true);
+        const bool out = timed_match(*p.regex, _text, p.local);
+        if (p.local.attempted >= RegexScratch::merge_interval)
+        {
+            p.shared->merge(p.local);
+        }
+        return out;
+    }
+
+    // As `search`, but through a scratch.
+    std::optional<RegexSpan> search(
+        RegexScratch &_scratch,
+        const std::string_view &_pattern,
+        const std::string_view &_text)
+    {
+        return held(_scratch, _pattern, false)
+            .regex->search(_text);
+    }
+
+    // Search text for a (cached) pattern. See RegEx::search.
+    // Unlike `match`, this records no metrics.
+    std::optional<RegexSpan> search(
+        const std::string &_pattern,
+        const std::string_view &_text)
+    {
+        std::shared_ptr<const RegEx> regex;
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            regex = fetch(expand(_pattern)).regex;
+        }
+        return regex->search(_text);
+    }
+
+    // Replace every match of a (cached) pattern in text. See
+    // regex_replace. This records no metrics.
+    std::string replace(const std::string &_pattern,
+                        const std::string_view &_text,
+                        const std::string_view &_with)
+    {
+        std::shared_ptr<const RegEx> regex;
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            regex = fetch(expand(_pattern)).regex;
+        }
+        return regex_replace(*regex, _text, _with);
+    }
+
+    // A copy of the metrics of every pattern matched so far.
+    std::vector<PatternMetricsSnapshot> metrics_snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        std::vector<PatternMetricsSnapshot> out;
+        for (const auto &p : metrics)
+        {
+            out.push_back(p.second->snapshot(p.first));
+        }
+        return out;
+    }
+
+    // All metrics, in the Prometheus text exposition format.
+    std::string metrics_prometheus() const
+    {
+        return to_prometheus(metrics_snapshot());
+    }
+
+    // Write all metrics to a file (such as one read by the node
+    // exporter's textfile collector). Returns false on failure.
+    bool write_metrics(const std::string &_path) const
+    {
+        return write_metrics_file(_path, metrics_prometheus());
+    }
+
+    // Send all metrics to a listening Unix domain socket.
+    // Returns false on failure.
+    bool push_metrics(const std::string &_socket_path) const
+    {
+        return write_metrics_socket(_socket_path,
+                                    metrics_prometheus());
+    }
+
+    // Set the maximum number of bytes the cache may hold. Zero
+    // means unlimited. Evicts immediately if need be.
+    void set_memory_budget(const size_t &_bytes)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        memory_budget = _bytes;
+        enforce_memory_budget();
+    }
+
+    size_t get_memory_budget() const
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return memory_budget;
+    }
+
+    // The estimated footprint of all cached patterns.
+    MemoryUsage memory_usage() const
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        MemoryUsage out;
+        for (const auto &p : cache)
+        {
+            out += p.second.usage;
+        }
+        return out;
+    }
+
+    // The number of compiled patterns currently cached.
+    size_t cache_size() const
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        return cache.size();
+    }
+
+    // Drop all cached patterns. Patterns still held by callers
+    // stay alive until released.
+    void clear_cache()
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        cache.clear();
+        lru.clear();
+        cached_bytes = 0;
+        ++generation;
+    }
+
+  protected:
+    struct CacheEntry
+    {
+        std::shared_ptr<RegEx> regex;
+        MemoryUsage usage;
+        std::list<std::string>::iterator position;
+    };
+
+    // Bytes spent on the cache's own record of a pattern.
+    static size_t cache_entry_overhead(const std::string &_key)
+    {
+        return 2 * (_key.capacity() + 1) + tree_node_overhead +
+               list_node_overhead + sizeof(CacheEntry) +
+               sizeof(std::string) * 2 + sizeof(RegEx);
+    }
+
+    // Run a match, timing it into `_stats`.
+    template <typename Metrics>
+    static bool timed_match(const RegEx &_regex,
+                            const std::string_view &_text,
+                            Metrics &_stats)
+    {
+        namespace clk = std::chrono;
+        size_t scanned;
+        const auto start = clk::steady_clock::now();
+        const bool out =
+            _regex.match(_text.data(), _text.size(), scanned);
+        const auto end = clk::steady_clock::now();
+
+        _stats.record(
+            out, !out && scanned < _text.size(), scanned,
+            clk::duration_cast<clk::nanoseconds>(end - start)
+                .count());
+        return out;
+    }
+
+    // The metrics of a pattern as requested, made on first
+    // use. Requires the cache lock.
+    std::shared_ptr<PatternMetrics> metrics_for(
+        const std::string &_pattern)
+    {
+        auto &slot = metrics[_pattern];
+        if (slot == nullptr)
+        {
+            slot = std::make_shared<PatternMetrics>();
+        }
+        return slot;
+    }
+
+    // A scratch's entry for a pattern, fetched under the cache
+    // lock only if it is missing or out of date, or lacks the
+    // metrics a match needs.
+    RegexScratch::Pattern &held(
+        RegexScratch &_scratch,
+        const std::string_view &_pattern, const bool &_counted)
+    {
+        if (_scratch.owner != this)
+        {
+            throw std::runtime_error(
+                "Scratch belongs to another manager.");
+        }
+
+        auto it = _scratch.patterns.find(_pattern);
+        if (it != _scratch.patterns.end() &&
+            it->second.generation ==
+                generation.load(std::memory_order_acquire) &&
+            (!_counted || it->second.shared != nullptr))
+        {
+            return it->second;
+        }
+
+        const std::string pattern(_pattern);
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (it == _scratch.patterns.end())
+        {
+            it = _scratch.patterns
+                     .emplace(pattern, RegexScratch::Pattern())
+                     .first;
+        }
+
+        RegexScratch::Pattern &out = it->second;
+        if (out.shared != nullptr)
+        {
+            out.shared->merge(out.local);
+        }
+        out.regex = fetch(expand(pattern)).regex;
+        if (_counted || out.shared != nullptr)
+        {
+            out.shared = metrics_for(pattern);
+        }
+        out.generation = generation;
+        return out;
+    }
+
+    // Expand every registered substitution in the given text.
+    // Requires the cache lock.
+    std::string substitute(const std::string &_on) const
     {
         std::string out = _on;
         bool done = false;
@@ -83,5 +472,87 @@ class RegexManager
         return out;
     }
 
+    // Substitute a pattern, remembering the result. Requires
+    // the cache lock.
+    const std::string &expand(const std::string &_pattern)
+    {
+        auto it = expansions.find(_pattern);
+        if (it == expansions.end())
+        {
+            it = expansions
+                     .emplace(_pattern, substitute(_pattern))
+                     .first;
+        }
+        return it->second;
+    }
+
+    // Find or compile the entry for an already substituted
+    // pattern. Requires the cache lock.
+    const CacheEntry &fetch(const std::string &_key)
+    {
+        auto it = cache.find(_key);
+        TOKEX_TRACE3(cache__lookup, this, _key.c_str(),
+                     it != cache.end());
+        if (it != cache.end())
+        {
+            lru.splice(lru.begin(), lru, it->second.position);
+            return it->second;
+        }
+
+        CacheEntry entry;
+        entry.regex = std::make_shared<RegEx>(
+            compile_regex(_key.c_str()));
+        entry.usage = entry.regex->memory_usage();
+        entry.usage.auxiliary += cache_entry_overhead(_key);
+
+        if (memory_budget != 0 &&
+            entry.usage.total() > memory_budget)
+        {
+            throw std::runtime_error(
+                "Compiled pattern exceeds memory budget.");
+        }
+
+        cached_bytes += entry.usage.total();
+        lru.push_front(_key);
+        entry.position = lru.begin();
+        it = cache.emplace(_key, std::move(entry)).first;
+
+        enforce_memory_budget();
+        return it->second;
+    }
+
+    // Evict least recently used patterns until under budget.
+    // Requires the cache lock.
+    void enforce_memory_budget()
+    {
+        while (memory_budget != 0 &&
+               cached_bytes > memory_budget && !lru.empty())
+        {
+            auto it = cache.find(lru.back());
+            cached_bytes -= it->second.usage.total();
+            cache.erase(it);
+            lru.pop_back();
+        }
+    }
+
     std::map<const std::string, std::string> substitutions;
+
+    // Compiled patterns, keyed by their substituted text, along
+    // with their recency (most recent first).
+    std::map<std::string, CacheEntry> cache;
+    std::list<std::string> lru;
+    size_t cached_bytes = 0, memory_budget = 0;
+
+    // Patterns as requested, and their substituted text
+    std::map<std::string, std::string> expansions;
+
+    // Metrics by pattern as requested. These outlive eviction.
+    std::map<std::string, std::shared_ptr<PatternMetrics>>
+        metrics;
+
+    // Changed under the cache lock whenever substitutions or
+    // the cache are, so that scratches fetch again.
+    std::atomic<uint64_t> generation = 1;
+
+    mutable std::mutex cache_mutex;
 };
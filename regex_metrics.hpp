@@ -0,0 +1,303 @@
+/*
+Per-pattern runtime metrics for RegexManager. Every counter is a
+relaxed atomic, so recording a match takes no locks and matching
+threads never wait on each other (or on a reader taking a
+snapshot). Threads matching through a scratch (see
+RegexScratch) count in plain counters of their own instead, and
+add them to the shared ones in batches. Snapshots can be
+rendered in the Prometheus text exposition format, and written
+to a file or to a local socket.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __unix__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Latency bucket i counts matches which took less than 2^i ns
+// (and at least 2^(i - 1) ns). The last bucket is unbounded.
+static const int latency_buckets = 32;
+
+inline int latency_bucket(const uint64_t &_ns) noexcept
+{
+    return std::min<int>(std::bit_width(_ns),
+                         latency_buckets - 1);
+}
+
+/*
+A point-in-time copy of one pattern's metrics.
+*/
+struct PatternMetricsSnapshot
+{
+    std::string pattern;
+    uint64_t attempted = 0, succeeded = 0, bytes_scanned = 0;
+    uint64_t early_rejects = 0, latency_ns_sum = 0;
+    std::array<uint64_t, latency_buckets> latency = {};
+};
+
+/*
+One thread's metrics for one pattern, not yet added to the
+pattern's shared metrics.
+*/
+struct LocalPatternMetrics
+{
+    uint64_t attempted = 0, succeeded = 0, bytes_scanned = 0;
+    uint64_t early_rejects = 0, latency_ns_sum = 0;
+    std::array<uint64_t, latency_buckets> latency = {};
+
+    // As PatternMetrics::record.
+    void record(const bool &_matched, const bool &_early_reject,
+                const uint64_t &_scanned,
+                const uint64_t &_ns) noexcept
+    {
+        ++attempted;
+        succeeded += _matched;
+        early_rejects += _early_reject;
+        bytes_scanned += _scanned;
+        latency_ns_sum += _ns;
+        ++latency[latency_bucket(_ns)];
+    }
+};
+
+/*
+The live metrics of one pattern.
+*/
+class PatternMetrics
+{
+  public:
+    // Record one match attempt. `_scanned` is the number of
+    // bytes examined; an early reject is a failed match which
+    // stopped before the end of its input.
+    void record(const bool &_matched, const bool &_early_reject,
+                const uint64_t &_scanned,
+                const uint64_t &_ns) noexcept
+    {
+        const auto relaxed = std::memory_order_relaxed;
+        attempted.fetch_add(1, relaxed);
+        succeeded.fetch_add(_matched, relaxed);
+        early_rejects.fetch_add(_early_reject, relaxed);
+        bytes_scanned.fetch_add(_scanned, relaxed);
+        latency_ns_sum.fetch_add(_ns, relaxed);
+        latency[latency_bucket(_ns)].fetch_add(1, relaxed);
+    }
+
+    // Add one thread's metrics to these, and reset them.
+    void merge(LocalPatternMetrics &_local) noexcept
+    {
+        const auto relaxed = std::memory_order_relaxed;
+        if (_local.attempted == 0)
+        {
+            return;
+        }
+
+        attempted.fetch_add(_local.attempted, relaxed);
+        succeeded.fetch_add(_local.succeeded, relaxed);
+        early_rejects.fetch_add(_local.early_rejects, relaxed);
+        bytes_scanned.fetch_add(_local.bytes_scanned, relaxed);
+        latency_ns_sum.fetch_add(_local.latency_ns_sum,
+                                 relaxed);
+        for (int i = 0; i < latency_buckets; ++i)
+        {
+            if (_local.latency[i] != 0)
+            {
+                latency[i].fetch_add(_local.latency[i],
+                                     relaxed);
+            }
+        }
+        _local = LocalPatternMetrics();
+    }
+
+    PatternMetricsSnapshot snapshot(
+        const std::string &_pattern) const noexcept
+    {
+        const auto relaxed = std::memory_order_relaxed;
+        PatternMetricsSnapshot out;
+        out.pattern = _pattern;
+        out.attempted = attempted.load(relaxed);
+        out.succeeded = succeeded.load(relaxed);
+        out.bytes_scanned = bytes_scanned.load(relaxed);
+        out.early_rejects = early_rejects.load(relaxed);
+        out.latency_ns_sum = latency_ns_sum.load(relaxed);
+        for (int i = 0; i < latency_buckets; ++i)
+        {
+            out.latency[i] = latency[i].load(relaxed);
+        }
+        return out;
+    }
+
+  protected:
+    std::atomic<uint64_t> attempted = 0, succeeded = 0;
+    std::atomic<uint64_t> bytes_scanned = 0, early_rejects = 0;
+    std::atomic<uint64_t> latency_ns_sum = 0;
+    std::array<std::atomic<uint64_t>, latency_buckets> latency =
+        {};
+};
+
+////////////////////////////////////////////////////////////////
+
+// Escape a Prometheus label value.
+inline std::string prometheus_label(const std::string &_what)
+{
+    std::string out;
+    for (const char &c : _what)
+    {
+        if (c == '\\' || c == '"')
+        {
+            out.push_back('\\');
+            out.push_back(c);
+        }
+        else if (c == '\n')
+        {
+            out += "\\n";
+        }
+        else
+        {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+/*
+Render snapshots in the Prometheus text exposition format.
+*/
+inline std::string to_prometheus(
+    const std::vector<PatternMetricsSnapshot> &_snapshots)
+{
+    std::ostringstream out;
+
+    const auto counter = [&](const char *_name,
+                             const char *_help,
+                             uint64_t PatternMetricsSnapshot::*
+                                 _of) {
+        out << "# HELP " << _name << ' ' << _help << '\n'
+            << "# TYPE " << _name << " counter\n";
+        for (const auto &s : _snapshots)
+        {
+            out << _name << "{pattern=\""
+                << prometheus_label(s.pattern) << "\"} "
+                << s.*_of << '\n';
+        }
+    };
+
+    counter("regex_matches_attempted_total",
+            "Match attempts per pattern.",
+            &PatternMetricsSnapshot::attempted);
+    counter("regex_matches_succeeded_total",
+            "Successful matches per pattern.",
+            &PatternMetricsSnapshot::succeeded);
+    counter("regex_bytes_scanned_total",
+            "Input bytes examined per pattern.",
+            &PatternMetricsSnapshot::bytes_scanned);
+    counter("regex_early_rejects_total",
+            "Failed matches which stopped before the end of "
+            "their input.",
+            &PatternMetricsSnapshot::early_rejects);
+
+    const char *const hist = "regex_match_latency_seconds";
+    out << "# HELP " << hist << " Match latency per pattern.\n"
+        << "# TYPE " << hist << " histogram\n";
+    for (const auto &s : _snapshots)
+    {
+        const std::string label =
+            "pattern=\"" + prometheus_label(s.pattern) + "\"";
+
+        uint64_t cumulative = 0;
+        for (int i = 0; i + 1 < latency_buckets; ++i)
+        {
+            cumulative += s.latency[i];
+            out << hist << "_bucket{" << label << ",le=\""
+                << (double)(1ull << i) * 1e-9 << "\"} "
+                << cumulative << '\n';
+        }
+        out << hist << "_bucket{" << label << ",le=\"+Inf\"} "
+            << s.attempted << '\n'
+            << hist << "_sum{" << label << "} "
+            << s.latency_ns_sum * 1e-9 << '\n'
+            << hist << "_count{" << label << "} " << s.attempted
+            << '\n';
+    }
+
+    return out.str();
+}
+
+/*
+Write text to a file such that readers never see it half
+written: it is written beside the target, then renamed over it.
+Returns false on failure.
+*/
+inline bool write_metrics_file(const std::string &_path,
+                               const std::string &_text)
+{
+    const std::string temp = _path + ".tmp";
+    {
+        std::ofstream file(temp);
+        if (!file.is_open() || !(file << _text))
+        {
+            return false;
+        }
+    }
+    return std::rename(temp.c_str(), _path.c_str()) == 0;
+}
+
+/*
+Write text to a listening Unix domain (stream) socket, such as
+a local metrics agent. Returns false on failure.
+*/
+inline bool write_metrics_socket(const std::string &_path,
+                                 const std::string &_text)
+{
+#ifdef __unix__
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (_path.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    _path.copy(address.sun_path, _path.size());
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    bool ok =
+        connect(fd, (sockaddr *)&address, sizeof(address)) == 0;
+    for (size_t sent = 0; ok && sent < _text.size();)
+    {
+        const ssize_t n = send(fd, _text.data() + sent,
+                               _text.size() - sent, flags);
+        ok = n > 0;
+        sent += ok ? n : 0;
+    }
+
+    close(fd);
+    return ok;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,331 @@
+/*
+An executor for automata of at most 16 states, such as most
+validation patterns. For each byte class it keeps a 16-byte row
+holding the next state from every state, so that a step is a
+single `pshufb` of that row by the current state, which is kept
+in a register. The row depends only on the input, so the chain
+from one state to the next has no memory load in it.
+
+`match_many` runs two inputs at once, one in each 128-bit half
+of an AVX2 register.
+
+The vector paths are chosen at runtime, so they are used even
+though the rest of the program is built for baseline x86-64.
+Elsewhere, and on processors without SSSE3, the same rows are
+walked one byte at a time.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "frozen.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#if defined(__GNUC__) &&                                       \
+    (defined(__x86_64__) || defined(__i386__))
+#define TOKEX_SHUFFLE_X86
+#include <immintrin.h>
+#endif
+
+class ShuffleRegex
+{
+  public:
+    // The most states, including the dead state, this handles.
+    static constexpr size_t max_states = 16;
+
+    // A pattern which matches nothing.
+    ShuffleRegex()
+    {
+        classes.fill(0);
+        rows.resize(1);
+        detect_cpu();
+    }
+
+    // Whether `_from` is small enough to be converted.
+    static bool fits(const FrozenRegex &_from) noexcept
+    {
+        return _from.state_count() <= max_states;
+    }
+
+    // Throws std::runtime_error if `_from` has too many states.
+    explicit ShuffleRegex(const FrozenRegex &_from)
+    {
+        if (!fits(_from))
+        {
+            throw std::runtime_error(
+                "Too many states for a shuffle table.");
+        }
+
+        rows.resize(_from.class_count());
+        for (int b = 0; b < 256; ++b)
+        {
+            classes[b] = _from.byte_class(b);
+            Row &row = rows[classes[b]];
+            for (uint32_t s = 0; s < _from.state_count(); ++s)
+            {
+                row.next[s] = _from.next_state(s, b);
+            }
+        }
+
+        for (uint32_t s = 0; s < _from.state_count(); ++s)
+        {
+            if (_from.is_accepting(s))
+            {
+                accepting |= 1 << s;
+            }
+        }
+        states = _from.state_count();
+        start = _from.start_state();
+        detect_cpu();
+    }
+
+    // Returns true if and only if all of the given bytes match
+    // the pattern. `_scanned` is set to the number of bytes
+    // examined, which is less than `_length` if the match was
+    // rejected early. This does not allocate.
+    bool match(const char *const _text, const size_t &_length,
+               size_t &_scanned) const noexcept
+    {
+        const unsigned char *const first =
+            (const unsigned char *)_text;
+#ifdef TOKEX_SHUFFLE_X86
+        if (has_ssse3)
+        {
+            return match_ssse3(first, _length, _scanned);
+        }
+#endif
+        const uint8_t state = run(start, first, _length);
+        if (state == FrozenRegex::dead_state && _length != 0)
+        {
+            _scanned = first_dead(start, first, _length) + 1;
+            return false;
+        }
+        _scanned = _length;
+        return is_accepting(state);
+    }
+
+    bool match(const char *const _text,
+               const size_t &_length) const noexcept
+    {
+        size_t scanned;
+        return match(_text, _length, scanned);
+    }
+
+    bool match(const std::string_view &_text) const noexcept
+    {
+        return match(_text.data(), _text.size());
+    }
+
+    // Match each of `_count` texts, writing the results to
+    // `_out`. Pairs of texts share one AVX2 register where that
+    // is available. This does not allocate.
+    void match_many(const std::string_view *const _texts,
+                    const size_t &_count,
+                    bool *const _out) const noexcept
+    {
+        size_t i = 0;
+#ifdef TOKEX_SHUFFLE_X86
+        if (has_avx2)
+        {
+            for (; i + 1 < _count; i += 2)
+            {
+                match_pair_avx2(_texts[i], _texts[i + 1],
+                                _out + i);
+            }
+        }
+#endif
+        for (; i < _count; ++i)
+        {
+            _out[i] = match(_texts[i]);
+        }
+    }
+
+    // The number of states, including the dead state.
+    size_t state_count() const noexcept
+    {
+        return states;
+    }
+
+    // The number of byte equivalence classes.
+    size_t class_count() const noexcept
+    {
+        return rows.size();
+    }
+
+    // The instructions `match` and `match_many` use here.
+    const char *instructions() const noexcept
+    {
+        return has_avx2    ? "ssse3, avx2"
+               : has_ssse3 ? "ssse3"
+                           : "scalar";
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage out;
+        out.transitions = rows.capacity() * sizeof(Row);
+        out.auxiliary = sizeof(classes);
+        return out;
+    }
+
+  protected:
+    // Bytes matched between checks for the dead state.
+    static constexpr size_t check_interval = 64;
+
+    struct alignas(16) Row
+    {
+        std::array<uint8_t, max_states> next = {};
+    };
+
+    void detect_cpu() noexcept
+    {
+#ifdef TOKEX_SHUFFLE_X86
+        __builtin_cpu_init();
+        has_ssse3 = __builtin_cpu_supports("ssse3");
+        has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    bool is_accepting(const uint8_t &_state) const noexcept
+    {
+        return (accepting >> _state) & 1;
+    }
+
+    // The state after reading `_length` bytes from `_state`.
+    uint8_t run(uint8_t _state,
+                const unsigned char *const _text,
+                const size_t &_length) const noexcept
+    {
+        for (size_t i = 0; i < _length; ++i)
+        {
+            _state = rows[classes[_text[i]]].next[_state];
+        }
+        return _state;
+    }
+
+    // The index of the byte which leads from `_state` to the
+    // dead state, which must be within `_length` bytes.
+    size_t first_dead(uint8_t _state,
+                      const unsigned char *const _text,
+                      const size_t &_length) const noexcept
+    {
+        size_t i = 0;
+        for (; i + 1 < _length; ++i)
+        {
+            _state = rows[classes[_text[i]]].next[_state];
+            if (_state == FrozenRegex::dead_state)
+            {
+                break;
+            }
+        }
+        return i;
+    }
+
+#ifdef TOKEX_SHUFFLE_X86
+    __attribute__((target("ssse3"))) bool match_ssse3(
+        const unsigned char *const _text, const size_t &_length,
+        size_t &_scanned) const noexcept
+    {
+        __m128i state = _mm_set1_epi8(start);
+        for (size_t i = 0; i < _length;)
+        {
+            const size_t block = i;
+            const __m128i before = state;
+            const size_t end =
+                std::min(_length, i + check_interval);
+            for (; i < end; ++i)
+            {
+                state = _mm_shuffle_epi8(
+                    _mm_load_si128(
+                        (const __m128i *)rows[classes[_text[i]]]
+                            .next.data()),
+                    state);
+            }
+
+            if ((uint8_t)_mm_cvtsi128_si32(state) ==
+                FrozenRegex::dead_state)
+            {
+                _scanned =
+                    block +
+                    first_dead(
+                        (uint8_t)_mm_cvtsi128_si32(before),
+                        _text + block, end - block) +
+                    1;
+                return false;
+            }
+        }
+
+        _scanned = _length;
+        return is_accepting((uint8_t)_mm_cvtsi128_si32(state));
+    }
+
+    __attribute__((target("avx2"))) void match_pair_avx2(
+        const std::string_view &_a, const std::string_view &_b,
+        bool *const _out) const noexcept
+    {
+        const unsigned char *const a =
+            (const unsigned char *)_a.data();
+        const unsigned char *const b =
+            (const unsigned char *)_b.data();
+        const size_t common = std::min(_a.size(), _b.size());
+
+        // The low half follows `_a`, and the high half `_b`
+        __m256i state = _mm256_set1_epi8(start);
+        for (size_t i = 0; i < common;)
+        {
+            const size_t end =
+                std::min(common, i + check_interval);
+            for (; i < end; ++i)
+            {
+                const __m256i row = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_load_si128(
+                        (const __m128i *)rows[classes[a[i]]]
+                            .next.data())),
+                    _mm_load_si128(
+                        (const __m128i *)rows[classes[b[i]]]
+                            .next.data()),
+                    1);
+                state = _mm256_shuffle_epi8(row, state);
+            }
+
+            // Both halves dead: neither can match
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                    state, _mm256_setzero_si256())) == -1)
+            {
+                _out[0] = _out[1] = false;
+                return;
+            }
+        }
+
+        // Finish the longer of the two alone
+        const uint8_t end_a = run(
+            (uint8_t)_mm256_extract_epi8(state, 0), a + common,
+            _a.size() - common);
+        const uint8_t end_b = run(
+            (uint8_t)_mm256_extract_epi8(state, 16), b + common,
+            _b.size() - common);
+        _out[0] = is_accepting(end_a);
+        _out[1] = is_accepting(end_b);
+    }
+#endif
+
+    // The equivalence class of each byte, as in FrozenRegex.
+    std::array<uint8_t, 256> classes;
+
+    // rows[class].next[state] is the next state.
+    std::vector<Row> rows;
+
+    // Bit `s` is set if state `s` is accepting.
+    uint16_t accepting = 0;
+    uint8_t start = FrozenRegex::dead_state;
+    size_t states = 1;
+
+    bool has_ssse3 = false, has_avx2 = false;
+};
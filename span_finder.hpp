@@ -0,0 +1,371 @@
+/*
+Finds the leftmost, then longest, match of a pattern within a
+text in two linear passes, rather than by running the pattern
+from each start in turn.
+
+The forward automaton runs over the text from the first start,
+following every start at once. Each of its states is the list of
+live states of the pattern, ordered by where their runs began,
+with a run dropped when an earlier one reaches the same state.
+Once some run accepts, runs which began after it can no longer
+be leftmost, so they are dropped and no new ones are begun. The
+last position at which any remaining run accepts is where the
+match ends.
+
+The reverse automaton is the pattern with every transition
+turned around, determinised. It runs backwards from the end of
+the match, and the furthest position at which it accepts is
+where the match begins.
+
+Both are built from a table of the pattern (a `FrozenRegex` or
+`CombRegex`), and index their rows by its byte classes, so a
+byte is classified the same way in either direction. Either may
+be far larger than the pattern's own table, so building stops
+at a size limit, after which the finder is unavailable.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#include "frozen.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+class SpanFinder
+{
+  public:
+    // A finder which is unavailable.
+    SpanFinder()
+    {
+        classes.fill(0);
+    }
+
+    // Build both automata from a table of a pattern, unless
+    // together they would take more than `_limit` bytes.
+    template <typename Table>
+    SpanFinder(const Table &_from, const size_t &_limit)
+    {
+        for (int b = 0; b < 256; ++b)
+        {
+            classes[b] = _from.byte_class(b);
+        }
+        number_classes = _from.class_count();
+        limit = _limit;
+
+        if (!build_forward(_from) || !build_reverse(_from))
+        {
+            *this = SpanFinder();
+        }
+    }
+
+    // Whether both automata were built within the limit.
+    bool available() const noexcept
+    {
+        return !forward.empty();
+    }
+
+    // Find the leftmost, then longest, match within `_length`
+    // bytes which begins at or after `_from`, setting `_begin`
+    // and `_end` to its bounds. Returns false if there is none.
+    // The finder must be available. This does not allocate.
+    bool find(const char *const _text, const size_t &_length,
+              const size_t &_from, size_t &_begin,
+              size_t &_end) const noexcept
+    {
+        const unsigned char *const text =
+            (const unsigned char *)_text;
+
+        // Forwards, to where the leftmost match ends
+        uint32_t state = forward_start;
+        size_t end = FrozenRegex::npos;
+        if (forward_accepting[state])
+        {
+            end = _from;
+        }
+        for (size_t i = _from; i < _length; ++i)
+        {
+            state = forward[state * number_classes +
+                            classes[text[i]]];
+            if (state == FrozenRegex::dead_state)
+            {
+                break;
+            }
+            else if (forward_accepting[state])
+            {
+                end = i + 1;
+            }
+        }
+        if (end == FrozenRegex::npos)
+        {
+            return false;
+        }
+
+        // Backwards from there, to where it begins
+        state = reverse_start;
+        size_t begin = FrozenRegex::npos;
+        if (reverse_accepting[state])
+        {
+            begin = end;
+        }
+        for (size_t i = end; i > _from; --i)
+        {
+            state = reverse[state * number_classes +
+                            classes[text[i - 1]]];
+            if (state == FrozenRegex::dead_state)
+            {
+                break;
+            }
+            else if (reverse_accepting[state])
+            {
+                begin = i - 1;
+            }
+        }
+        if (begin == FrozenRegex::npos)
+        {
+            return false;
+        }
+
+        _begin = begin;
+        _end = end;
+        return true;
+    }
+
+    // The number of states in each automaton, including their
+    // dead states.
+    size_t forward_count() const noexcept
+    {
+        return forward_accepting.size();
+    }
+
+    size_t reverse_count() const noexcept
+    {
+        return reverse_accepting.size();
+    }
+
+    MemoryUsage memory_usage() const
+    {
+        MemoryUsage out;
+        out.states = forward_accepting.capacity() +
+                     reverse_accepting.capacity();
+        out.transitions = (forward.capacity() +
+                           reverse.capacity()) *
+                          sizeof(uint32_t);
+        out.auxiliary = sizeof(classes);
+        return out;
+    }
+
+  protected:
+    // The live states of the pattern, in the order their runs
+    // began, and whether runs are still being begun.
+    typedef std::pair<bool, std::vector<uint32_t>> Runs;
+
+    // Whether another state of `_states` states fits beside
+    // `_other` existing entries.
+    bool fits(const size_t &_states,
+              const size_t &_other) const noexcept
+    {
+        return (_other + _states * number_classes) *
+                   sizeof(uint32_t) <=
+               limit;
+    }
+
+    // One byte of each class, to read the table with.
+    std::vector<unsigned char> class_members() const
+    {
+        std::vector<unsigned char> out(number_classes);
+        for (int b = 255; b >= 0; --b)
+        {
+            out[classes[b]] = b;
+        }
+        return out;
+    }
+
+    // Begin a run at the current position if runs are still
+    // being begun, then end every run after the first which
+    // accepts. Returns whether one did.
+    template <typename Table>
+    static bool settle(const Table &_from, Runs &_runs)
+    {
+        auto &states = _runs.second;
+        const uint32_t start = _from.start_state();
+        if (_runs.first &&
+            std::find(states.begin(), states.end(), start) ==
+                states.end())
+        {
+            states.push_back(start);
+        }
+
+        for (size_t i = 0; i < states.size(); ++i)
+        {
+            if (_from.is_accepting(states[i]))
+            {
+                states.resize(i + 1);
+                _runs.first = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename Table>
+    bool build_forward(const Table &_from)
+    {
+        const std::vector<unsigned char> member =
+            class_members();
+        std::map<Runs, uint32_t> ids;
+        std::vector<Runs> found;
+
+        const auto intern = [&](Runs &&_runs,
+                                const bool &_accepting) {
+            const auto it = ids.find(_runs);
+            if (it != ids.end())
+            {
+                return it->second;
+            }
+            const uint32_t id = found.size();
+            ids.emplace(_runs, id);
+            found.push_back(std::move(_runs));
+            forward_accepting.push_back(_accepting);
+            return id;
+        };
+
+        // No runs, and none to begin: the dead state
+        intern(Runs(false, {}), false);
+        Runs first(true, {});
+        const bool accepting = settle(_from, first);
+        forward_start = intern(std::move(first), accepting);
+
+        for (uint32_t id = 0; id < found.size(); ++id)
+        {
+            if (!fits(found.size(), 0))
+            {
+                return false;
+            }
+
+            for (size_t c = 0; c < number_classes; ++c)
+            {
+                Runs next(found[id].first, {});
+                for (const uint32_t &s : found[id].second)
+                {
+                    const uint32_t to =
+                        _from.next_state(s, member[c]);
+                    if (to != FrozenRegex::dead_state &&
+                        std::find(next.second.begin(),
+                                  next.second.end(),
+                                  to) == next.second.end())
+                    {
+                        next.second.push_back(to);
+                    }
+                }
+
+                const bool accepts = settle(_from, next);
+                forward.push_back(
+                    intern(std::move(next), accepts));
+            }
+        }
+        return true;
+    }
+
+    template <typename Table>
+    bool build_reverse(const Table &_from)
+    {
+        const std::vector<unsigned char> member =
+            class_members();
+        const size_t n = _from.state_count();
+
+        // The states which lead to each state on each class
+        std::vector<std::vector<uint32_t>> from(
+            n * number_classes);
+        for (uint32_t s = 0; s < n; ++s)
+        {
+            for (size_t c = 0; c < number_classes; ++c)
+            {
+                const uint32_t to =
+                    _from.next_state(s, member[c]);
+                if (to != FrozenRegex::dead_state)
+                {
+                    from[to * number_classes + c].push_back(s);
+                }
+            }
+        }
+
+        std::map<std::vector<uint32_t>, uint32_t> ids;
+        std::vector<std::vector<uint32_t>> found;
+        const auto intern = [&](std::vector<uint32_t> &&_set) {
+            const auto it = ids.find(_set);
+            if (it != ids.end())
+            {
+                return it->second;
+            }
+            const uint32_t id = found.size();
+            ids.emplace(_set, id);
+            reverse_accepting.push_back(
+                std::binary_search(_set.begin(), _set.end(),
+                                   _from.start_state()));
+            found.push_back(std::move(_set));
+            return id;
+        };
+
+        // Runs backwards begin from every accepting state
+        intern({});
+        std::vector<uint32_t> last;
+        for (uint32_t s = 1; s < n; ++s)
+        {
+            if (_from.is_accepting(s))
+            {
+                last.push_back(s);
+            }
+        }
+        reverse_start = intern(std::move(last));
+
+        std::vector<bool> seen(n);
+        for (uint32_t id = 0; id < found.size(); ++id)
+        {
+            if (!fits(found.size(), forward.size()))
+            {
+                return false;
+            }
+
+            for (size_t c = 0; c < number_classes; ++c)
+            {
+                std::vector<uint32_t> prior;
+                for (const uint32_t &s : found[id])
+                {
+                    for (const uint32_t &p :
+                         from[s * number_classes + c])
+                    {
+                        if (!seen[p])
+                        {
+                            seen[p] = true;
+                            prior.push_back(p);
+                        }
+                    }
+                }
+                for (const uint32_t &p : prior)
+                {
+                    seen[p] = false;
+                }
+
+                std::sort(prior.begin(), prior.end());
+                reverse.push_back(intern(std::move(prior)));
+            }
+        }
+        return true;
+    }
+
+    std::array<uint8_t, 256> classes;
+    size_t number_classes = 1, limit = 0;
+
+    // forward[state * number_classes + class] is the next
+    // state, and likewise for `reverse`. State 0 is dead in
+    // both.
+    std::vector<uint32_t> forward, reverse;
+    std::vector<uint8_t> forward_accepting, reverse_accepting;
+    uint32_t forward_start = 0, reverse_start = 0;
+};
@@ -4,11 +4,8 @@ types.
 
 Process:
 1) Regex
-2) Regex subexpressions
-3) Partial epsilon-NFAs
-4) Assembled epsilon-NFA
-5) DFA with dead nodes
-6) DFA
+2) Epsilon-NFA, by Thompson's construction (see `Nfa`)
+3) DFA, by subset construction (see `determinize`)
 
 Jordan Dehmel, 2024.
 */
@@ -17,13 +14,17 @@ Jordan Dehmel, 2024.
 
 #include "expression.hpp"
 #include "lexer.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <fstream>
 #include <map>
+#include <queue>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #ifdef SAVEFIG
@@ -40,11 +41,19 @@ template <typename T = Token> class Tokex
     {
     }
 
-    Tokex(const std::vector<T> &_pattern)
+    Tokex(const std::vector<T> &_pattern,
+          const NfaOptions &_options = NfaOptions())
     {
-        compile(_pattern);
+        compile(_pattern, _options);
     }
 
+    // Machines own their nodes, so they may be moved but not
+    // copied.
+    Tokex(const Tokex<T> &_other) = delete;
+    Tokex(Tokex<T> &&_other) noexcept;
+    Tokex<T> &operator=(const Tokex<T> &_other) = delete;
+    Tokex<T> &operator=(Tokex<T> &&_other) noexcept;
+
     ~Tokex();
 
     // Return the type of the current node, which is the
@@ -53,9 +62,8 @@ template <typename T = Token> class Tokex
 
     // Create a new Tokex structure from a pattern.
     // The default syntax here is `sapling2`.
-    void compile(const std::vector<T> &pattern);
-    Expression<T> compile(const std::vector<T> &pattern,
-                          const int &_begin, const int &_end);
+    void compile(const std::vector<T> &pattern,
+                 const NfaOptions &_options = NfaOptions());
 
     // Run on the given input. These work on simple DFA rules;
     // all the complexity of this system comes from compile.
@@ -87,6 +95,12 @@ template <typename T = Token> class Tokex
     // Returns all REACHABLE nodes in the graph.
     std::list<Node<T> *> get_all_nodes();
 
+    // The entry node, or nullptr if nothing was compiled.
+    const Node<T> *get_beginning() const
+    {
+        return beginning;
+    }
+
     // Print the graph.
     void print();
 
@@ -99,6 +113,11 @@ template <typename T = Token> class Tokex
     // Erases all unreachable nodes.
     void purge();
 
+    // Estimate the number of heap bytes held by this machine,
+    // broken down into states, transitions and auxiliary
+    // bookkeeping.
+    MemoryUsage memory_usage() const;
+
   protected:
     // Dynamically allocate a new node on the heap. This also
     // adds the newly created node to the set of all nodes
@@ -106,8 +125,9 @@ template <typename T = Token> class Tokex
     // memory leaks.
     Node<T> *create_node();
 
-    Expression<T> duplicate_expression(
-        const Expression<T> &_what);
+    // Replace this machine's nodes with a DFA equivalent to
+    // `_nfa`.
+    void determinize(const Nfa<T> &_nfa);
 
     // Pointer to the entry node
     Node<T> *beginning = nullptr;
@@ -127,8 +147,13 @@ template <typename T = Token> class Tokex
 template <typename T>
 bool Tokex<T>::match(const std::list<T> &input)
 {
+    TOKEX_TRACE2(match__start, this, input.size());
+
     reset();
-    return state_to_bool(run(input));
+    const bool out = state_to_bool(run(input));
+
+    TOKEX_TRACE2(match__end, this, out);
+    return out;
 }
 
 // Delete a Tokex machine
@@ -146,6 +171,37 @@ template <typename T> Tokex<T>::~Tokex()
     allNodes.clear();
 }
 
+// Take ownership of another machine's nodes
+template <typename T>
+Tokex<T>::Tokex(Tokex<T> &&_other) noexcept
+{
+    *this = std::move(_other);
+}
+
+template <typename T>
+Tokex<T> &Tokex<T>::operator=(Tokex<T> &&_other) noexcept
+{
+    if (this != &_other)
+    {
+        for (Node<T> *item : allNodes)
+        {
+            delete item;
+        }
+
+        beginning = _other.beginning;
+        current = _other.current;
+        allNodes = std::move(_other.allNodes);
+        memory = std::move(_other.memory);
+        variables = std::move(_other.variables);
+
+        _other.beginning = nullptr;
+        _other.current = nullptr;
+        _other.allNodes.clear();
+    }
+
+    return *this;
+}
+
 // Get the current state of the machine
 template <typename T> NodeType Tokex<T>::get_state()
 {
@@ -205,64 +261,6 @@ template <typename T> Node<T> *Tokex<T>::create_node()
     return out;
 }
 
-template <typename T>
-Expression<T> Tokex<T>::duplicate_expression(
-    const Expression<T> &_what)
-{
-    // Get all reachable nodes
-    std::map<Node<T> *, Node<T> *> old_to_new;
-    std::queue<Node<T> *> to_visit;
-    to_visit.push(_what.first);
-
-    // Map existing nodes to newly allocated ones
-    while (!to_visit.empty())
-    {
-        auto cur = to_visit.front();
-        to_visit.pop();
-
-        if (!old_to_new.contains(cur))
-        {
-            if (cur != nullptr)
-            {
-                old_to_new[cur] = create_node();
-
-                old_to_new[cur]->type = cur->type;
-                old_to_new[cur]->script = cur->script;
-
-                for (const auto &p : cur->next)
-                {
-                    to_visit.push(p.second);
-                }
-            }
-            else
-            {
-                old_to_new[cur] = nullptr;
-            }
-        }
-    }
-
-    for (const auto &node : old_to_new)
-    {
-        if (node.first == nullptr)
-        {
-            continue;
-        }
-
-        // For each node, add transitions
-        for (const auto &p : node.first->next)
-        {
-            assert(old_to_new.contains(p.second));
-            old_to_new[node.first]->next[p.first] =
-                old_to_new[p.second];
-        }
-    }
-
-    // Build output
-    Expression<T> out;
-    out.first = old_to_new[_what.first];
-    return out;
-}
-
 template <typename T>
 std::list<Node<T> *> Tokex<T>::get_all_nodes()
 {
@@ -438,6 +436,7 @@ template <typename T> void Tokex<T>::purge()
         if (!reachable.contains(item))
         {
             allNodes.erase(item);
+            delete item;
         }
     }
 
@@ -447,6 +446,37 @@ template <typename T> void Tokex<T>::purge()
     }
 }
 
+// Estimate the heap footprint of this machine. Only nodes owned
+// by this machine are counted.
+template <typename T> MemoryUsage Tokex<T>::memory_usage() const
+{
+    MemoryUsage out;
+
+    for (const Node<T> *node : allNodes)
+    {
+        out.states += sizeof(Node<T>);
+        out.states += node->script.size() *
+                      (list_node_overhead + sizeof(T));
+        out.transitions +=
+            node->next.size() *
+            (tree_node_overhead + sizeof(*node->next.begin()));
+    }
+
+    // Ownership set, memory and variables
+    out.auxiliary += allNodes.size() *
+                     (tree_node_overhead + sizeof(Node<T> *));
+    out.auxiliary +=
+        memory.size() * (list_node_overhead + sizeof(T));
+    for (const auto &p : variables)
+    {
+        out.auxiliary +=
+            tree_node_overhead + sizeof(p) +
+            p.second.size() * (list_node_overhead + sizeof(T));
+    }
+
+    return out;
+}
+
 // Returns true if this is an epsilon-NFA, false if it's a DFA.
 template <typename T> bool Tokex<T>::has_epsilons() const
 {
@@ -465,240 +495,122 @@ template <typename T> bool Tokex<T>::has_epsilons() const
     return false;
 }
 
-////////////////////////////////////////////////////////////////
-
-template <typename T>
-void Tokex<T>::compile(const std::vector<T> &pattern)
-{
-    // Fetch compiled results
-    Expression<T> res = compile(pattern, 0, pattern.size());
-    beginning = res.first;
-
-    // Append success node
-    Node<T> *success = create_node();
-    success->type = end;
-    Expression<T> expr;
-    expr.first = success;
-    res.knit_other_onto_end(expr);
-
-    // Print if set up to do so
-#ifdef SAVEFIG
-
-    static uint64_t id = 0;
-
-    graphviz(std::to_string(id) + ".eps.dot");
-    system(("dot -Tpng " + std::to_string(id) + ".eps.dot -o " +
-            std::to_string(id) + ".eps.png")
-               .c_str());
-
-#endif
-
-    // Remove epsilon transitions
-    res.remove_epsilons();
-
-    // Remove dead nodes
-    purge();
-
-    // Print if set up to do so
-#ifdef SAVEFIG
-
-    graphviz(std::to_string(id) + ".dot");
-    system(("dot -Tpng " + std::to_string(id) + ".dot -o " +
-            std::to_string(id) + ".png")
-               .c_str());
-
-#ifdef SAVEFIGPATH
-    system(("mv " + std::to_string(id) + ".* " SAVEFIGPATH)
-               .c_str());
-#endif
-
-    ++id;
-
-#endif
-}
-
-// Compiles the given pattern into a directed graph to be used
-// as a tokex machine
+/*
+Subset construction: each node stands for the set of NFA states
+which some input could have reached. From a set, a token leads
+to every state its own transitions or a wildcard lead to, so a
+node never needs to fall back from one to the other. Nodes are
+numbered in the order they are found, so the result does not
+depend on where they are allocated.
+*/
 template <typename T>
-Expression<T> Tokex<T>::compile(const std::vector<T> &pattern,
-                                const int &_begin,
-                                const int &_end)
+void Tokex<T>::determinize(const Nfa<T> &_nfa)
 {
-    static Node<T> *const NEXT_NODE = nullptr;
-
-    // Break into subexpressions on a pseudo-stack
-    // Compile subexpressions individually according to rules
-    std::vector<Expression<T>> expressions;
-    for (int i = _begin; i < _end; ++i)
-    {
-        if (T::is_escape(pattern[i]))
+    typedef std::vector<size_t> Subset;
+    std::map<Subset, Node<T> *> subset_to_node;
+    std::queue<Subset> to_visit;
+
+    // The node for a set of states, made on first use
+    const auto node_for = [&](const Subset &_subset) {
+        auto it = subset_to_node.find(_subset);
+        if (it == subset_to_node.end())
         {
-            // ...
-            // (beg) -...-> _
-            ++i;
-
-            Expression<T> to_add;
-            to_add.first = create_node();
-
-            to_add.first->next[pattern[i]] = NEXT_NODE;
+            Node<T> *node = create_node();
+            if (std::binary_search(_subset.begin(),
+                                   _subset.end(), _nfa.last))
+            {
+                node->type = end;
+            }
 
-            expressions.push_back(to_add);
+            it = subset_to_node.emplace(_subset, node).first;
+            to_visit.push(_subset);
         }
+        return it->second;
+    };
 
-        else if (T::is_subexpr_open(pattern[i]))
-        {
-            int count = 1;
-            ++i;
-            std::vector<int> delims;
+    beginning = node_for(_nfa.closure({_nfa.first}));
+    while (!to_visit.empty())
+    {
+        const Subset cur = to_visit.front();
+        to_visit.pop();
+        Node<T> *const from = subset_to_node.at(cur);
 
-            // Gather breakpoints, raise error if unclosed
-            delims.push_back(i - 1);
-            while (true)
+        // Where each named token and the wildcard lead
+        std::map<T, Subset> named;
+        Subset wildcard;
+        for (const size_t &s : cur)
+        {
+            for (const auto &edge : _nfa.states[s].next)
             {
-                if (i >= _end)
+                if (T::is_wildcard(edge.first))
                 {
-                    throw std::runtime_error(
-                        "Unmatched opening subexpression "
-                        "token.");
+                    wildcard.push_back(edge.second);
                 }
-                else if (T::is_subexpr_open(pattern[i]))
-                {
-                    ++count;
-                }
-                else if (T::is_disjunction(pattern[i]))
-                {
-                    if (count == 1)
-                    {
-                        delims.push_back(i);
-                    }
-                }
-                else if (T::is_subexpr_close(pattern[i]))
-                {
-                    --count;
-
-                    if (count == 0)
-                    {
-                        delims.push_back(i);
-                        break;
-                    }
-                    else if (count < 0)
-                    {
-                        throw std::runtime_error(
-                            "Unmatched closing subexpression "
-                            "token.");
-                    }
-                }
-
-                ++i;
-            }
-
-            // Compile breakpoints into expressions
-            std::vector<Expression<T>> subexpressions;
-            Expression<T> final_expr;
-            for (size_t j = 0; j + 1 < delims.size(); ++j)
-            {
-                subexpressions.push_back(compile(
-                    pattern, delims[j] + 1, delims[j + 1]));
-            }
-
-            // Merge expressions if need be
-            if (subexpressions.size() > 1)
-            {
-                final_expr = subexpressions[0];
-                for (size_t j = 1; j < subexpressions.size();
-                     ++j)
+                else
                 {
-                    final_expr.add_other_as_suit(
-                        subexpressions[j]);
+                    named[edge.first].push_back(edge.second);
                 }
             }
-            else if (subexpressions.size() == 1)
-            {
-                final_expr = subexpressions[0];
-            }
-
-            // Append merged and compiled expression
-            expressions.push_back(final_expr);
         }
 
-        else if (T::is_wildcard(pattern[i]))
+        for (auto &p : named)
         {
-            // .
-            // (beg) -any-> _
-
-            Expression<T> to_add;
-            to_add.first = create_node();
-
-            to_add.first->next[T::wildcard()] = NEXT_NODE;
-
-            expressions.push_back(to_add);
+            p.second.insert(p.second.end(), wildcard.begin(),
+                            wildcard.end());
+            from->next[p.first] =
+                node_for(_nfa.closure(p.second));
         }
-
-        else if (T::is_optional(pattern[i]))
+        if (!wildcard.empty())
         {
-            // ...?
-            // (beg) -...-> _
-            // (beg) -eps-> _
-
-            assert(!expressions.empty());
-            expressions.back().first->next[T::epsilon()] =
-                NEXT_NODE;
+            from->next[T::wildcard()] =
+                node_for(_nfa.closure(wildcard));
         }
-        else if (T::is_star(pattern[i]))
-        {
-            // ...*
-            // (beg) -eps-> _
-            // (beg) -...-> (beg)
-
-            assert(!expressions.empty());
-            expressions.back().knit_other_onto_end(
-                expressions.back());
-            expressions.back().first->next[T::epsilon()] =
-                NEXT_NODE;
-        }
-        else if (T::is_plus(pattern[i]))
-        {
-            // ...+
-            // (beg) -...-> (A)
-            // (A) -...-> (A)
-            // (A) -eps-> _
+    }
+}
 
-            assert(!expressions.empty());
+////////////////////////////////////////////////////////////////
 
-            expressions.push_back(
-                duplicate_expression(expressions.back()));
+template <typename T>
+void Tokex<T>::compile(const std::vector<T> &pattern,
+                       const NfaOptions &_options)
+{
+    TOKEX_TRACE2(compile__start, this, pattern.size());
 
-            expressions.back().knit_other_onto_end(
-                expressions.back());
+    // Build an epsilon-NFA
+    TOKEX_TRACE1(parse__start, this);
+    const Nfa<T> nfa(pattern, _options);
+    TOKEX_TRACE1(parse__end, this);
 
-            expressions.back().first->next[T::epsilon()] =
-                NEXT_NODE;
-        }
+    // Determinise it into nodes
+    TOKEX_TRACE1(close__start, this);
+    determinize(nfa);
+    TOKEX_TRACE1(close__end, this);
 
-        // Literal
-        else
-        {
-            // ...
-            // (beg) -...-> _
+    // Remove dead nodes
+    TOKEX_TRACE1(purge__start, this);
+    purge();
+    TOKEX_TRACE1(purge__end, this);
 
-            Expression<T> to_add;
-            to_add.first = create_node();
+    // Print if set up to do so
+#ifdef SAVEFIG
 
-            to_add.first->next[pattern[i]] = NEXT_NODE;
+    static uint64_t id = 0;
 
-            expressions.push_back(to_add);
-        }
-    }
+    graphviz(std::to_string(id) + ".dot");
+    system(("dot -Tpng " + std::to_string(id) + ".dot -o " +
+            std::to_string(id) + ".png")
+               .c_str());
 
-    // Assemble subexpressions
-    Expression<T> expression = expressions.front();
-    for (size_t i = 1; i < expressions.size(); ++i)
-    {
-        expression.knit_other_onto_end(expressions[i]);
-    }
+#ifdef SAVEFIGPATH
+    system(("mv " + std::to_string(id) + ".* " SAVEFIGPATH)
+               .c_str());
+#endif
+
+    ++id;
+
+#endif
 
-    // Return result
-    return expression;
+    TOKEX_TRACE2(compile__end, this, allNodes.size());
 }
 
 // Run the machine on a single token.
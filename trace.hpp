@@ -0,0 +1,55 @@
+/*
+Static tracepoints for the compile and match hot paths.
+
+When built with `-DTOKEX_USDT` (`make USDT=1`) on a system which
+provides `<sys/sdt.h>` (systemtap-sdt-dev on Debian), each probe
+below becomes a USDT probe in the `tokex` provider: a single
+`nop` in the instruction stream plus an ELF note, which tools
+such as `bpftrace` and `perf probe` can attach to in a live
+process. Otherwise the probes (and their arguments) compile away
+entirely. For instance:
+
+    bpftrace -e 'usdt:./regex_main.out:tokex:match__start
+        { @s[tid] = nsecs; }
+        usdt:./regex_main.out:tokex:match__end
+        { @ns = hist(nsecs - @s[tid]); }'
+
+Probes:
+- compile__start(machine, pattern length)
+- compile__end(machine, nodes allocated)
+- parse__start, parse__end(machine)
+- close__start, close__end(machine)
+- purge__start, purge__end(machine)
+- match__start(machine, input length)
+- match__end(machine, matched)
+
+The match probes fire from `Tokex::match` and from
+`RegEx::match`, where the machine is the RegEx and the probes
+fire whichever engine it dispatches to.
+- lex__start(lexer, text length)
+- lex__end(lexer, tokens produced)
+- cache__lookup(manager, pattern, hit)
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#pragma once
+
+#if defined(TOKEX_USDT) && __has_include(<sys/sdt.h>)
+
+#include <sys/sdt.h>
+
+#define TOKEX_TRACE1(_name, _a) DTRACE_PROBE1(tokex, _name, _a)
+#define TOKEX_TRACE2(_name, _a, _b)                            \
+    DTRACE_PROBE2(tokex, _name, _a, _b)
+#define TOKEX_TRACE3(_name, _a, _b, _c)                        \
+    DTRACE_PROBE3(tokex, _name, _a, _b, _c)
+
+#else
+
+#define TOKEX_TRACE1(_name, _a)
+#define TOKEX_TRACE2(_name, _a, _b)
+#define TOKEX_TRACE3(_name, _a, _b, _c)
+
+#endif